@@ -55,7 +55,7 @@
 #define MIN_MONITOR_INTERVAL_MS 1000
 #define MAX_MONITOR_INTERVAL_MS 60000
 #define MIN_CPU_THRESHOLD 1
-#define MAX_CPU_THRESHOLD 100
+#define MAX_CPU_THRESHOLD 6400 // above 100 only meaningful with CpuNormalization=core
 #define MIN_MEM_THRESHOLD_MB 1
 #define MAX_MEM_THRESHOLD_MB 65536
 #define MIN_HANG_TIMEOUT_MS 1000
@@ -64,10 +64,171 @@
 #define MAX_LOG_SIZE_BYTES 100 * 1024 * 1024
 #define MIN_MAX_HUNG_WINDOWS 10
 #define MAX_MAX_HUNG_WINDOWS 5000
+#define DEFAULT_THROTTLE_AFFINITY_CORES 1
+#define MIN_THROTTLE_AFFINITY_CORES 1
+#define MAX_THROTTLE_AFFINITY_CORES 64
+#define DEFAULT_CPU_RATE_CAP_PERCENT 25
+#define MIN_CPU_RATE_CAP_PERCENT 1
+#define MAX_CPU_RATE_CAP_PERCENT 100
+#define DEFAULT_THROTTLE_IDLE_PRIORITY 0
+#define DEFAULT_MEM_CAP_COMMIT_LIMIT_MB 0 // 0 = twice MemThresholdMb
+#define MIN_MEM_CAP_COMMIT_LIMIT_MB 0
+#define MAX_MEM_CAP_COMMIT_LIMIT_MB 131072
+#define DEFAULT_MEM_CAP_ESCALATE_MS 60000
+#define MIN_MEM_CAP_ESCALATE_MS 5000
+#define MAX_MEM_CAP_ESCALATE_MS 3600000
+#define MEM_CAP_COMMIT_PRESSURE_PERCENT 95
+#define MEM_CAP_PINNED_PERCENT 95 // working set at this share of the hard maximum counts as pinned
+#define DEFAULT_TREE_AGGREGATION 0
+#define DEFAULT_TREE_CPU_THRESHOLD_PERCENT 90 // 0 = no tree CPU rule
+#define MIN_TREE_CPU_THRESHOLD 0
+#define MAX_TREE_CPU_THRESHOLD 6400
+#define DEFAULT_TREE_MEM_THRESHOLD_MB 2048 // 0 = no tree memory rule
+#define MIN_TREE_MEM_THRESHOLD_MB 0
+#define MAX_TREE_MEM_THRESHOLD_MB 1048576
+#define SCAN_INITIAL_CAPACITY 512
+#define DEFAULT_CPU_SATURATION_PERCENT 0 // 0 = off
+#define MIN_CPU_SATURATION_PERCENT 0
+#define MAX_CPU_SATURATION_PERCENT 100
+#define DEFAULT_CPU_GRACE_SEC 0 // e.g. 10 to let installers, compilers and launchers spike at start
+#define DEFAULT_MEM_GRACE_SEC 0
+#define DEFAULT_HANG_GRACE_SEC 0
+#define MIN_GRACE_SEC 0
+#define MAX_GRACE_SEC 3600
+#define DEFAULT_AGE_RAMP_SEC 0 // 0 = thresholds do not depend on age
+#define MIN_AGE_RAMP_SEC 0
+#define MAX_AGE_RAMP_SEC 86400
+#define DEFAULT_AGE_THRESHOLD_SCALE_PERCENT 200
+#define MIN_AGE_THRESHOLD_SCALE_PERCENT 100
+#define MAX_AGE_THRESHOLD_SCALE_PERCENT 1000
+#define DEFAULT_HYSTERESIS_EXIT_PERCENT 90
+#define MIN_HYSTERESIS_EXIT_PERCENT 50
+#define MAX_HYSTERESIS_EXIT_PERCENT 100
+#define DEFAULT_VIOLATION_DWELL_MS 0
+#define MIN_VIOLATION_DWELL_MS 0
+#define MAX_VIOLATION_DWELL_MS 600000
+#define DEFAULT_RECOVERY_DWELL_MS 30000
+#define MIN_RECOVERY_DWELL_MS 0
+#define MAX_RECOVERY_DWELL_MS 3600000
+#define DEFAULT_KILL_RATE_PER_MINUTE 0 // 0 = unlimited
+#define DEFAULT_RULE_KILL_RATE_PER_MINUTE 0
+#define MIN_KILL_RATE_PER_MINUTE 0
+#define MAX_KILL_RATE_PER_MINUTE 1000
+#define DEFAULT_STORM_THRESHOLD 0 // 0 = storm detection off
+#define MIN_STORM_THRESHOLD 0
+#define MAX_STORM_THRESHOLD 1000
+#define DEFAULT_SCAN_WORKERS 0 // 0 = one per logical processor, up to AUTO_SCAN_WORKERS
+#define MIN_SCAN_WORKERS 0
+#define MAX_SCAN_WORKERS 16
+#define MONITOR_SCAN_WORKER MAX_SCAN_WORKERS // g.scanWorkerState slot of the monitor thread
+#define AUTO_SCAN_WORKERS 4
+#define NO_SCAN_SLOT ((DWORD)-1) // MeasureProcess: compute CPU% at once instead of in ComputeScanUsage
+#define SCAN_CHUNK_SIZE 32      // processes a measurement worker claims at a time
+#define SCAN_WORKER_RUNNING 0   // SCAN_WORKER.state
+#define SCAN_WORKER_BLOCKED 1   // opening a process, may be left behind by MeasureScan
+#define SCAN_WORKER_ORPHANED 2  // MeasureScan stopped waiting for it
+#define HISTORY_SHARD_COUNT 64  // power of two
+#define ARENA_BLOCK_SIZE (16 * 1024) // smallest arena block
+#define HISTORY_POOL_SLAB 64    // PROCESS_HISTORY records per pool slab
+#define BALLOON_POOL_SLAB 16    // BALLOON_COOLDOWN records per pool slab
+#define STRING_ID_NONE 0
+#define INTERN_CHUNK_SIZE 1024  // string table entries per chunk
+#define INTERN_MAX_CHUNKS 64    // at most 64K distinct names and paths
+#define INTERN_INITIAL_SLOTS 4096
+#define PATH_SCRATCH_LEN 1024   // stack buffer for image paths; longer ones go to the heap
+#define ALIGN_ALLOC(n) (((n) + MEMORY_ALLOCATION_ALIGNMENT - 1) & ~(size_t)(MEMORY_ALLOCATION_ALIGNMENT - 1))
+#define STATUS_READ_RETRIES 8   // attempts to read a consistent published status
+#define DEFAULT_START_STAGGER_MS 0 // 0 = first scan at once
+#define MIN_START_STAGGER_MS 0
+#define MAX_START_STAGGER_MS 600000
+#define OVERRUN_LOG_INTERVAL_MS 60000 // at most one overrun log line per minute
+#define DEFAULT_ADAPTIVE_INTERVAL 0
+#define DEFAULT_ADAPTIVE_MIN_INTERVAL_MS 1000
+#define DEFAULT_ADAPTIVE_MAX_INTERVAL_MS 30000
+#define MIN_ADAPTIVE_INTERVAL_MS 250
+#define MAX_ADAPTIVE_INTERVAL_MS 600000
+#define DEFAULT_ADAPTIVE_NEAR_PERCENT 80 // a process above this share of a threshold counts as close
+#define MIN_ADAPTIVE_NEAR_PERCENT 10
+#define MAX_ADAPTIVE_NEAR_PERCENT 100
+#define SELF_COST_EWMA_SHIFT 3 // monitor CPU cost is averaged over about 8 ticks
+#define DEFAULT_BACKGROUND_MODE 0
+#define DEFAULT_SELF_CPU_BUDGET_PERCENT 0 // of one core; 0 = no CPU budget
+#define MIN_SELF_CPU_BUDGET_PERCENT 0
+#define MAX_SELF_CPU_BUDGET_PERCENT 100
+#define DEFAULT_SELF_MEMORY_BUDGET_MB 0 // 0 = no memory budget
+#define MIN_SELF_MEMORY_BUDGET_MB 0
+#define MAX_SELF_MEMORY_BUDGET_MB 4096
+#define MAX_GOVERNOR_LEVEL 3 // the interval is widened up to 2^3 times
+#define DEFAULT_WATCHDOG_STALL_MS 0 // 0 = watchdog off
+#define MIN_WATCHDOG_STALL_MS 0
+#define MAX_WATCHDOG_STALL_MS 3600000
+#define WATCHDOG_POLL_MS 1000
+#define WATCHDOG_REPORT_EMPTY 0   // GLOBAL.watchdogReportState
+#define WATCHDOG_REPORT_WRITING 1 // the watchdog is filling watchdogReport
+#define WATCHDOG_REPORT_READY 2   // waiting for the monitor thread to log it
+#define DECIDE_STALL_SKIP_MS 300000 // a process the decision stage stalled on is skipped this long
+#define LATENCY_BUCKETS 20 // log2 ms buckets; the last one holds everything from 2^18 ms
+#define LATENCY_REPORT_INTERVAL_MS 3600000 // phase histograms are logged hourly
+#define HEARTBEAT_READ_RETRIES 8
+#define DEFAULT_TIERED_SAMPLING 0
+#define DEFAULT_TIER_HOT_PERCENT 50 // share of a threshold from which a process is sampled every scan
+#define DEFAULT_TIER_WARM_PERCENT 10
+#define MIN_TIER_PERCENT 0
+#define MAX_TIER_PERCENT 100
+#define DEFAULT_TIER_WARM_EVERY 4 // scans between samples of a warm process
+#define MIN_TIER_WARM_EVERY 1
+#define MAX_TIER_WARM_EVERY 100
+#define DEFAULT_TIER_COLD_BATCH 64 // cold processes sampled per scan
+#define MIN_TIER_COLD_BATCH 1
+#define MAX_TIER_COLD_BATCH 100000
+#define DEFAULT_SCAN_BUDGET_PROCESSES 0 // 0 = unlimited
+#define MIN_SCAN_BUDGET_PROCESSES 0
+#define MAX_SCAN_BUDGET_PROCESSES 1000000
+#define DEFAULT_SCAN_BUDGET_US 0 // 0 = unlimited
+#define MIN_SCAN_BUDGET_US 0
+#define MAX_SCAN_BUDGET_US 10000000
+#define DEFAULT_PRESSURE_GATING 0
+#define DEFAULT_PRESSURE_CPU_PERCENT 70
+#define DEFAULT_PRESSURE_MEMORY_PERCENT 85
+#define DEFAULT_PRESSURE_COMMIT_PERCENT 90
+#define MIN_PRESSURE_PERCENT 1
+#define MAX_PRESSURE_PERCENT 100
+#define PRESSURE_HOLD_MS 30000 // stay armed this long after the last stressed sample
+#define DEFAULT_VICTIM_SELECTION 0
+#define DEFAULT_VICTIM_MAX_PER_SCAN 1
+#define MIN_VICTIM_MAX_PER_SCAN 1
+#define MAX_VICTIM_MAX_PER_SCAN 16
+#define VICTIM_GROWTH_MINUTES 10       // growth is scored as the memory it would add in this time
+#define VICTIM_LEAK_ONLY_WEIGHT 0.5    // predicted (not yet over threshold) candidates
+#define VICTIM_CPU_RULE_WEIGHT 1.5     // also over the CPU rule
+#define VICTIM_FOREGROUND_WEIGHT 0.25  // owns the foreground window
+#define VICTIM_YOUNG_WEIGHT 0.5        // started less than VICTIM_YOUNG_AGE_MS ago
+#define VICTIM_YOUNG_AGE_MS 60000
+#define DEFAULT_LEAK_DETECTION 0 // 0 = off, 1 = log only, 2 = log and apply MemAction
+#define MIN_LEAK_DETECTION 0
+#define MAX_LEAK_DETECTION 2
+#define DEFAULT_LEAK_HORIZON_SEC 600
+#define MIN_LEAK_HORIZON_SEC 30
+#define MAX_LEAK_HORIZON_SEC 86400
+#define DEFAULT_LEAK_MIN_SAMPLES 12
+#define MIN_LEAK_MIN_SAMPLES 4
+#define MAX_LEAK_MIN_SAMPLES LEAK_WINDOW
+#define DEFAULT_LEAK_MIN_GROWTH_MB_PER_MIN 5
+#define MIN_LEAK_MIN_GROWTH_MB_PER_MIN 1
+#define MAX_LEAK_MIN_GROWTH_MB_PER_MIN 10000
+#define LEAK_WINDOW 32        // samples kept per process for the growth trend
+#define LEAK_MIN_R_SQUARED 0.8 // fit quality required to call growth "sustained"
 
 #define TERMINATE_RETRY_LIMIT 5
+#define TERMINATE_CONFIRM_TIMEOUT_MS 5000 // wait for the process handle to signal after TerminateProcess
+#define TERMINATE_RETRY_BASE_MS 1000      // executor backoff: 1 s, 2 s, 4 s, ...
+#define QUERY_HANDLE_RETRY_MS 60000       // re-open interval for processes we could not open
+#define DEFAULT_CPU_CLOSE_TIMEOUT_MS 0 // 0 = terminate without a close request
+#define DEFAULT_MEM_CLOSE_TIMEOUT_MS 0
+#define DEFAULT_HANG_CLOSE_TIMEOUT_MS 0   // a hung window cannot process WM_CLOSE
+#define MIN_CLOSE_TIMEOUT_MS 0
+#define MAX_CLOSE_TIMEOUT_MS 120000
 #define LOG_RENAME_RETRY_LIMIT 10
-#define INTERNAL_PATH_BUFFER_SIZE MAX_LONG_PATH
 #define MAX_BACKOFF_WAIT_MS 60000
 #define CONFIG_POLL_INTERVAL_MS 5000
 #define CRITICAL_SECTION_SPIN_COUNT 4000
@@ -96,21 +257,112 @@
 #define IDM_EXIT 1005
 #define IDM_VIEWMANUAL 1006
 
+// Detection rules (indexes into CONFIG.ruleAction)
+#define RULE_NONE -1
+#define RULE_CPU 0
+#define RULE_MEM 1
+#define RULE_HANG 2
+#define RULE_COUNT 3
+
+// Actions that can be taken when a rule is violated
+#define ACTION_TERMINATE 0
+#define ACTION_LOWER_PRIORITY 1
+#define ACTION_RESTRICT_AFFINITY 2
+#define ACTION_CPU_RATE_CAP 3
+#define ACTION_MEMORY_CAP 4
+#define ACTION_COUNT 5
+
+// Names used for CpuAction / MemAction in config.ini (indexed by ACTION_*)
+static const WCHAR *ACTION_NAMES[ACTION_COUNT] = {L"terminate", L"priority", L"affinity", L"cpucap", L"memcap"};
+
+// Memory metrics selectable with MemMetric (indexes into MEM_METRIC_NAMES)
+#define MEM_METRIC_WORKING_SET 0
+#define MEM_METRIC_PRIVATE 1
+#define MEM_METRIC_PRIVATE_WS 2
+#define MEM_METRIC_COUNT 3
+
+static const WCHAR *MEM_METRIC_NAMES[MEM_METRIC_COUNT] = {L"workingset", L"private", L"privatews"};
+static const WCHAR *MEM_METRIC_LABELS[MEM_METRIC_COUNT] = {L"working set", L"private bytes", L"private working set"};
+
+// Per-process violation state (PROCESS_HISTORY.vstate)
+#define VSTATE_NORMAL 0
+#define VSTATE_WARNING 1   // over the enter threshold, waiting out ViolationDwellMs
+#define VSTATE_VIOLATING 2 // enforcement armed
+#define VSTATE_ACTED 3     // action applied; held until RecoveryDwellMs below the exit threshold
+#define VSTATE_COUNT 4
+
+// Input level for the state machine
+#define VLEVEL_CLEAR 0    // below the exit threshold of every rule
+#define VLEVEL_ELEVATED 1 // between exit and enter thresholds
+#define VLEVEL_OVER 2     // a rule is violated
+#define VLEVEL_COUNT 3
+
+// Units of CpuThresholdPercent selectable with CpuNormalization (indexes into CPU_NORM_NAMES)
+#define CPU_NORM_CORE 0    // percent of one logical processor (a process on 8 cores can reach 800%)
+#define CPU_NORM_MACHINE 1 // percent of all logical processors
+#define CPU_NORM_ALLOWED 2 // percent of the processors in the process's affinity mask
+#define CPU_NORM_COUNT 3
+
+static const WCHAR *CPU_NORM_NAMES[CPU_NORM_COUNT] = {L"core", L"machine", L"allowed"};
+static const WCHAR *CPU_NORM_LABELS[CPU_NORM_COUNT] = {L"", L" of machine", L" of allowed cores"};
+
+// What the scheduler does with ticks missed while a scan overran (indexes into OVERRUN_NAMES)
+#define OVERRUN_SKIP 0     // drop them and wait for the next tick on the grid
+#define OVERRUN_COALESCE 1 // run one late tick at once, then continue on the grid
+#define OVERRUN_COUNT 2
+
+static const WCHAR *OVERRUN_NAMES[OVERRUN_COUNT] = {L"skip", L"coalesce"};
+
+// Phases of a monitor tick, reported to the stall watchdog (indexes into PHASE_NAMES)
+#define PHASE_WAIT 0         // between ticks; never a stall
+#define PHASE_HOUSEKEEPING 1 // config reload, resume handling, balloon cleanup
+#define PHASE_LOG 2          // log rotation
+#define PHASE_WINDOWS 3      // hung window scan
+#define PHASE_SNAPSHOT 4     // process snapshot and system pressure
+#define PHASE_MEASURE 5
+#define PHASE_DECIDE 6       // rules, victim selection and process trees
+#define PHASE_CLEANUP 7      // history cleanup and status
+#define PHASE_COUNT 8
+
+static const WCHAR *PHASE_NAMES[PHASE_COUNT] = {L"wait", L"housekeeping", L"log rotation", L"hung window scan",
+                                                L"process snapshot", L"measurement", L"decisions", L"cleanup"};
+
+// Sampling tiers of TieredSampling (PROCESS_HISTORY.tier)
+#define TIER_HOT 0  // near a limit, in a violation state or new: every scan
+#define TIER_WARM 1 // above TierWarmPercent: every TierWarmEvery scans
+#define TIER_COLD 2 // the rest: TierColdBatch per scan, round-robin
+#define TIER_COUNT 3
+
+// Job object CPU rate control (Windows 8+). Declared locally because the SDK
+// headers only expose it when targeting _WIN32_WINNT >= 0x0602.
+typedef struct _PM_JOB_CPU_RATE_CONTROL
+{
+    DWORD ControlFlags;
+    DWORD CpuRate; // in 1/100 of a percent of total machine CPU
+} PM_JOB_CPU_RATE_CONTROL;
+#define PM_JOB_OBJECT_CPU_RATE_CONTROL_INFORMATION ((JOBOBJECTINFOCLASS)15)
+#define PM_JOB_CPU_RATE_CONTROL_ENABLE 0x1
+#define PM_JOB_CPU_RATE_CONTROL_HARD_CAP 0x4
+
 // Exponential backoff delays for log rotation (ms)
 static const DWORD LOG_RENAME_DELAYS[] = {100, 200, 400, 800, 1600, 3200, 5000, 5000, 5000, 5000};
 
 // -------------------- Forward declarations --------------------
+typedef DWORD STRING_ID; // interned name or path (STRING_TABLE); STRING_ID_NONE is ""
 typedef struct _BALLOON_COOLDOWN BALLOON_COOLDOWN;
 typedef struct _PROCESS_HISTORY PROCESS_HISTORY;
 typedef struct _HUNG_PROCESS_NODE HUNG_PROCESS_NODE;
 typedef struct _ENUM_HUNG_PARAMS ENUM_HUNG_PARAMS;
+typedef struct _SCAN_ENTRY SCAN_ENTRY;
+typedef struct _TERMINATE_REQUEST TERMINATE_REQUEST;
 typedef struct _CONFIG CONFIG;
 typedef struct _GLOBAL GLOBAL;
 
 // Balloon cooldown linked list
 struct _BALLOON_COOLDOWN
 {
-    WCHAR processName[MAX_PATH_LEN];
+    STRING_ID nameId;
+    WCHAR *rawName; // heap copy of a name the string table could not hold (nameId STRING_ID_NONE)
     ULONGLONG lastTick;
     struct _BALLOON_COOLDOWN *next;
 };
@@ -125,15 +377,79 @@ struct _CONFIG
     DWORD logMaxSizeBytes;
     DWORD maxHungWindows;
     BOOL notifyOnTermination;
+    int ruleAction[RULE_COUNT];
+    DWORD ruleGraceSec[RULE_COUNT]; // no enforcement until the process is this old
+    DWORD ruleCloseTimeoutMs[RULE_COUNT]; // WM_CLOSE first, force after this long (0 = force at once)
+    DWORD ageRampSec;
+    DWORD ageThresholdScalePercent;
+    DWORD hysteresisExitPercent;
+    DWORD violationDwellMs;
+    DWORD recoveryDwellMs;
+    DWORD killRatePerMinute;
+    DWORD ruleKillRatePerMinute[RULE_COUNT];
+    DWORD stormThreshold;
+    DWORD throttleAffinityCores;
+    DWORD cpuRateCapPercent;
+    BOOL throttleIdlePriority;
+    DWORD memCapCommitLimitMb;
+    DWORD memCapEscalateMs;
+    int memMetric;
+    int cpuNormalization;
+    BOOL pressureGating;
+    DWORD pressureCpuPercent;
+    DWORD pressureMemoryPercent;
+    DWORD pressureCommitPercent;
+    BOOL victimSelection;
+    DWORD victimMaxPerScan;
+    DWORD cpuSaturationPercent;
+    DWORD leakDetection;
+    DWORD leakHorizonSec;
+    DWORD leakMinSamples;
+    DWORD leakMinGrowthMbPerMin;
+    BOOL treeAggregation;
+    DWORD treeCpuThresholdPercent;
+    DWORD treeMemThresholdMb;
+    DWORD scanWorkers;
+    int overrunPolicy;
+    DWORD startStaggerMs;
+    BOOL adaptiveInterval;
+    DWORD adaptiveMinIntervalMs;
+    DWORD adaptiveMaxIntervalMs;
+    DWORD adaptiveNearPercent;
+    BOOL tieredSampling;
+    DWORD tierHotPercent;
+    DWORD tierWarmPercent;
+    DWORD tierWarmEvery;
+    DWORD tierColdBatch;
+    DWORD scanBudgetProcesses;
+    DWORD scanBudgetUs;
+    BOOL backgroundMode;
+    DWORD selfCpuBudgetPercent;
+    DWORD selfMemoryBudgetMb;
+    DWORD watchdogStallMs;
     WCHAR excludeList[MAX_EXCLUDE_COUNT][MAX_PATH_LEN];
     int excludeCount;
     BOOL monitoringDefault;
 };
 
+// Sliding-window linear regression of memory over time. The sums are updated in O(1)
+// per sample (add the new point, subtract the evicted one).
+typedef struct _LEAK_TREND
+{
+    ULONGLONG baseTick; // time origin for t (GetTickCount64)
+    float t[LEAK_WINDOW]; // seconds since baseTick
+    float m[LEAK_WINDOW]; // MB
+    int count;
+    int next;
+    double sumT, sumM, sumTT, sumTM, sumMM;
+    BOOL reported;
+} LEAK_TREND;
+
 // Process history linked list
 struct _PROCESS_HISTORY
 {
     DWORD pid;
+    DWORD parentPid; // from the snapshot; with nameId identifies records without hQuery
     FILETIME ftCreate;
     FILETIME ftKernel;
     FILETIME ftUser;
@@ -142,6 +458,26 @@ struct _PROCESS_HISTORY
     int terminateAttemptsHung;
     int terminateLogSent;
     int terminateLogSentHung;
+    int terminateAttemptsTree;
+    int terminateLogSentTree;
+    DWORD throttleApplied; // bitmask of (1 << ACTION_*) already applied
+    HANDLE hJob;           // job object created for CPU rate or memory capping, or NULL
+    ULONGLONG memCapTick;  // when the memory cap was applied (0 = not capped)
+    ULONGLONG memCapPressureSince; // start of the current reclaim-pressure streak (0 = none)
+    LEAK_TREND leak;
+    BOOL terminatePending; // handed to the action executor, outcome not yet reported
+    BYTE vstate;           // VSTATE_*
+    ULONGLONG vstateSince; // when the current state (or the current clear streak) began
+    HANDLE hQuery;         // query handle kept open for the life of the record, or NULL
+    ULONGLONG queryOpenFailTick; // last failed open of hQuery (retried after QUERY_HANDLE_RETRY_MS)
+    STRING_ID nameId;
+    STRING_ID pathId;      // full image path, resolved once when the record is created
+    BYTE tier;             // TIER_*, from the last sample
+    BYTE kind;             // SAMPLE_* of the last sample
+    DWORD sampledScan;     // g.tierScan of the last sample
+    float lastCpu;         // last sample, stands in for the process on scans that skip it
+    size_t lastMemMB;
+    ULONGLONG decideSkipUntil; // the decision stage stalled on it; skipped until then
     BOOL seen;
     struct _PROCESS_HISTORY *next;
 };
@@ -150,9 +486,283 @@ struct _PROCESS_HISTORY
 struct _HUNG_PROCESS_NODE
 {
     DWORD pid;
+    FILETIME ftCreate; // zero if the process could not be queried
     struct _HUNG_PROCESS_NODE *next;
 };
 
+// Termination handed to the action executor thread. Requests travel on g.actionQueue;
+// finished ones come back on g.actionResults so the scan thread can update history.
+struct _TERMINATE_REQUEST
+{
+    DWORD pid;
+    FILETIME createTime; // identity of the process the decision was made about
+    STRING_ID nameId;
+    int attempts;
+    ULONGLONG notBefore; // GetTickCount64 of the next attempt (retry backoff)
+    DWORD closeTimeoutMs; // graceful close window, 0 = force immediately
+    BOOL closeRequested;
+    HANDLE hProcess;     // held while waiting for a graceful close
+    HANDLE hWait;        // RegisterWaitForSingleObject handle while on g.actionWaiting
+    BOOL exited;         // outcome, set when moved to the result list
+    struct _TERMINATE_REQUEST *next;
+};
+
+// Machine-wide load sampled once per scan (see EvaluateSystemPressure)
+typedef struct _SYSTEM_PRESSURE
+{
+    ULONGLONG prevIdle, prevKernel, prevUser; // GetSystemTimes at the previous sample
+    DWORD cpuPercent;
+    DWORD memoryPercent;
+    DWORD commitPercent;
+    ULONGLONG totalPhysMb;
+    BOOL memoryStressed; // memory load or commit charge at or above its threshold
+    BOOL armed;
+    ULONGLONG lastStressedTick;
+} SYSTEM_PRESSURE;
+
+// Termination circuit breaker: token buckets (global and per rule) plus storm detection
+typedef struct _KILL_BREAKER
+{
+    double tokens;
+    double ruleTokens[RULE_COUNT];
+    ULONGLONG lastRefillTick; // 0 = buckets not yet filled
+    DWORD violationsThisScan;
+    DWORD violationsLastScan;
+    BOOL storm; // log-only until a scan has no more than StormThreshold violations
+    DWORD suppressedRateScan;
+    DWORD suppressedStormScan;
+    ULONGLONG suppressedTotal;
+} KILL_BREAKER;
+
+// One process of the current snapshot (rebuilt every tick)
+// What the measurement stage decided about a process
+#define SAMPLE_SKIP 0   // own process, excluded, or no history record
+#define SAMPLE_SYSTEM 1 // built-in system process: reported, never acted on
+#define SAMPLE_NORMAL 2
+
+// One process as measured by a scan worker. Filled without logging or acting, then
+// consumed in enumeration order by CheckProcess.
+typedef struct _PROCESS_SAMPLE
+{
+    PROCESS_HISTORY *hist;
+    BOOL histPending;           // hist was created by a worker and is not linked yet
+    PROCESS_HISTORY *histStale; // record hist replaces once linked, or NULL
+    const WCHAR *path; // text of hist->pathId, or L""
+    int kind;          // SAMPLE_*
+    BOOL valid;        // the process could be opened and the counters below were read
+    float cpu;         // normalized per CpuNormalization
+    float rawCpu;      // percent of one core
+    float avgCpu;      // lifetime average, system processes only (< 0 if unavailable)
+    DWORD allowedCores;
+    size_t memMB;
+    BOOL memValid;
+    BOOL nearLimit;    // could reach a threshold; otherwise a NORMAL process takes the quiet path
+} PROCESS_SAMPLE;
+
+// Bulk counters of the scan, one slot per g.scan index, kept in parallel arrays so the
+// CPU% pass runs over contiguous memory. Each slot is written by the worker measuring
+// it; ComputeScanUsage then derives CPU% and the near-limit flag for every slot in one
+// loop. All arrays share one allocation, sized with the scan capacity.
+typedef struct _SCAN_COUNTERS
+{
+    ULONGLONG *cpuTime;     // kernel + user, 100 ns units
+    ULONGLONG *prevCpuTime; // at the previous sample of the process
+    LONGLONG *stamp;        // QueryPerformanceCounter when cpuTime was read
+    LONGLONG *prevStamp;
+    ULONGLONG *memMB;       // 0 if memory was not measured
+    float *cpuScale;        // CpuNormScale of the process
+    float *cores;           // allowed cores (saturation rule)
+    float *rawCpu;          // outputs
+    float *cpu;
+    BYTE *nearLimit;
+    void *block;
+} SCAN_COUNTERS;
+
+// Scratch state of one measuring thread, so workers share nothing while they measure.
+// Slot MONITOR_SCAN_WORKER belongs to the monitor thread.
+typedef struct _SCAN_WORKER
+{
+    PSAPI_WORKING_SET_INFORMATION *wsInfo; // reusable QueryWorkingSet buffer
+    DWORD wsInfoSize;
+    volatile LONG state; // SCAN_WORKER_*
+    DWORD pid;           // process being opened while BLOCKED or ORPHANED
+} SCAN_WORKER;
+
+// PROCESS_HISTORY records are spread over shards by PID. The lists belong to the monitor
+// thread: scan workers only read them while it is measuring too, and hand new records
+// back through PROCESS_SAMPLE for the monitor thread to link (PublishSampleHistory).
+// No lock is taken on any history path.
+typedef struct _HISTORY_SHARD
+{
+    PROCESS_HISTORY *head;
+} HISTORY_SHARD;
+
+// Bump allocator; nothing is freed individually. g.scanArena holds data that only lives
+// until the end of one ProcessSnapshot (the hung window list) and is monitor-thread only:
+// ArenaReset rewinds it, folding any overflow blocks into one so the next scan does not
+// grow it. The string table keeps its text in an arena that is never rewound.
+typedef struct _ARENA_BLOCK
+{
+    struct _ARENA_BLOCK *next;
+    size_t size; // usable bytes after the header
+    size_t used;
+} ARENA_BLOCK;
+
+typedef struct _ARENA
+{
+    ARENA_BLOCK *head; // block being filled
+} ARENA;
+
+// Interned process names and image paths, referred to by 32-bit IDs. Text is matched
+// case-insensitively (ASCII folding), so the first spelling seen is the one kept. Entries
+// never move, so StringFromId takes no lock; InternString takes csStrings.
+
+typedef struct _INTERN_ENTRY
+{
+    const WCHAR *text;
+    DWORD hash; // of the case-folded text
+    DWORD length;
+} INTERN_ENTRY;
+
+typedef struct _STRING_TABLE
+{
+    INTERN_ENTRY *chunks[INTERN_MAX_CHUNKS]; // INTERN_CHUNK_SIZE entries each
+    volatile LONG count; // IDs in use, including STRING_ID_NONE
+    STRING_ID *slots;    // open addressing on hash, STRING_ID_NONE = empty
+    DWORD slotCount;     // power of two, kept at most half full
+    BOOL fullLogged;     // the table-full warning has been logged
+    ARENA text;
+} STRING_TABLE;
+
+// Fixed-size object pool for long-lived records. Free slots sit on an interlocked SList,
+// so scan workers can allocate while the monitor thread frees without a lock; slabs go
+// back to the heap only in PoolDestroy.
+typedef struct _OBJECT_POOL
+{
+    SLIST_HEADER freeSlots;
+    SLIST_HEADER slabs;
+    size_t slotSize;
+    DWORD slotsPerSlab;
+} OBJECT_POOL;
+
+// Tick statistics of the monitor thread's deadline scheduler, owned by that thread.
+// Lateness is how long after its deadline a tick started.
+typedef struct _TICK_SCHEDULER
+{
+    ULONGLONG ticks;
+    DWORD overruns;     // scans that ran past the next deadline
+    DWORD skippedTicks; // deadlines dropped or merged because of overruns
+    ULONGLONG lateSumMs;
+    DWORD lateMaxMs;
+    ULONGLONG lastOverrunLog;
+    DWORD intervalMs;      // interval to the next deadline (MonitorIntervalMs unless adaptive)
+    DWORD shortened;       // adaptive decisions that shortened / lengthened the interval
+    DWORD lengthened;
+    ULONGLONG selfCpuPrev; // monitor process CPU time (100 ns) at the previous tick
+    ULONGLONG selfCpuStamp; // MonotonicMs of selfCpuPrev
+    DWORD cpuMsPerHour;    // monitor CPU cost, averaged over recent ticks
+    DWORD tickCpuMs;       // monitor CPU time over the last tick period
+    DWORD tickCpuMaxMs;
+    DWORD selfMemMB;       // monitor working set at the last tick
+} TICK_SCHEDULER;
+
+// Self-budget governor. Each level above 0 doubles the scan interval and sheds optional
+// work that enforcement does not depend on (status details and the hourly phase latency
+// log). Monitor thread only.
+typedef struct _SELF_GOVERNOR
+{
+    DWORD level;
+    DWORD ticksAtLevel;
+    DWORD governedTicks; // ticks run with level > 0
+} SELF_GOVERNOR;
+
+// Where the monitor thread is, for the watchdog thread. Written by the monitor thread as
+// a seqlock (seq is odd while the fields change); pid and pidSince are updated on their
+// own as the decision stage moves through the processes (see EnterDecision).
+typedef struct _HEARTBEAT
+{
+    volatile LONG seq;
+    int phase;             // PHASE_*
+    volatile LONG pid;     // process being decided on, or 0
+    ULONGLONG since;       // MonotonicMs when the phase began
+    volatile LONGLONG pidSince; // MonotonicMs when pid was set
+} HEARTBEAT;
+
+// Durations of one phase, in log2 millisecond buckets (see RecordPhaseLatency).
+// Monitor thread only.
+typedef struct _PHASE_STATS
+{
+    DWORD count;
+    DWORD maxMs;
+    DWORD buckets[LATENCY_BUCKETS];
+} PHASE_STATS;
+
+// Summary of the last scan for the UI thread. Written only by the monitor thread into
+// the buffer readers are not pointed at, then published by swapping g.statusIndex; seq
+// is odd while a buffer is being written, so a reader that raced a later rewrite of
+// the same buffer notices and retries.
+typedef struct _SCAN_STATUS
+{
+    volatile LONG seq;
+    ULONGLONG scanTick;  // GetTickCount64 when the scan finished (0 = no scan yet)
+    DWORD scanMs;
+    DWORD processCount;
+    DWORD trackedCount;  // history records
+    DWORD historyLookups; // lock-free lookups made by the scan
+    LONG lockWaits;      // times a shared lock was found held (csStrings, csConfig, csLog)
+    LONG heapAllocs;     // heap allocations made by the scan (0 in steady state)
+    DWORD nearLimitCount; // processes that needed the full decision path
+    ULONGLONG ticks;      // scheduler ticks since start (see TICK_SCHEDULER)
+    DWORD overruns;
+    DWORD skippedTicks;
+    DWORD lateAvgMs;
+    DWORD lateMaxMs;
+    DWORD intervalMs;
+    DWORD shortened;
+    DWORD lengthened;
+    DWORD cpuMsPerHour;
+    DWORD tickCpuMs;
+    DWORD tickCpuMaxMs;
+    DWORD selfMemMB;
+    DWORD governorLevel;
+    DWORD governedTicks;
+    LONG stalls;
+    LONG abandoned;
+    int slowestPhase;
+    DWORD slowestPhaseMs;
+    BOOL tiered;
+    DWORD sampled[TIER_COUNT]; // processes measured by the scan, by tier
+    DWORD deferred;            // processes the scan skipped (tier not due or budget spent)
+    BOOL detailsShed;          // trackedCount and top* carried over, shed by the governor
+    DWORD topCpuPid;
+    float topCpu;
+    WCHAR topCpuName[MAX_PATH_LEN];
+    DWORD topMemPid;
+    size_t topMemMB;
+    WCHAR topMemName[MAX_PATH_LEN];
+} SCAN_STATUS;
+
+struct _SCAN_ENTRY
+{
+    PROCESSENTRY32W pe;
+    PROCESS_SAMPLE sample;
+    PROCESS_HISTORY *hist; // set for measured processes; valid until CleanupHistory
+    float cpu;
+    size_t memMB;
+    BOOL eligible; // normal (non-system, non-excluded) process
+    BOOL measured;
+    int parentIndex; // index of the parent entry, or -1
+    int pendingChildren;
+    float treeCpu;    // subtree totals, including this process
+    size_t treeMemMB;
+    DWORD treeCount;
+    BOOL memCandidate; // breached the memory rule; deferred to SelectMemoryVictims
+    BOOL leakOnly;     // candidate only because of a predicted leak
+    BYTE tier;         // tier the entry was planned under (TieredSampling)
+    BOOL deferred;     // not measured this scan; cpu/memMB carry the last sample
+    BOOL sampled;      // MeasureProcess completed for it this scan
+};
+
 // EnumWindows parameters
 struct _ENUM_HUNG_PARAMS
 {
@@ -169,13 +779,21 @@ struct _GLOBAL
     HINSTANCE hInst;
     HWND hWnd;
     HANDLE hMonitorThread;
+    HANDLE hActionThread;
+    HANDLE hActionEvent; // auto-reset, signalled when a request is queued
     HANDLE hStopEvent;
     volatile LONG programRunning;
     volatile LONG monitorActive;
     CRITICAL_SECTION csLog;
-    CRITICAL_SECTION csHistory;
+    HISTORY_SHARD historyShards[HISTORY_SHARD_COUNT];
     CRITICAL_SECTION csConfig;
     CRITICAL_SECTION csBalloon;
+    CRITICAL_SECTION csActions; // actionQueue, actionResults and actionWaiting
+    TERMINATE_REQUEST *actionQueue;
+    TERMINATE_REQUEST *actionResults;
+    TERMINATE_REQUEST *actionWaiting; // graceful closes awaiting exit or timeout
+    TERMINATE_REQUEST *actionInFlight; // taken off the queue by the executor, not yet back
+    BOOL actionShutdown;
     NOTIFYICONDATA nid;
     HANDLE hMutex;
     WCHAR exeDir[MAX_LONG_PATH];
@@ -193,9 +811,64 @@ struct _GLOBAL
     CONFIG config;
     FILETIME configLastWrite;
     int configLoadFailed;
-    PROCESS_HISTORY *history;
     HPOWERNOTIFY hPowerNotify;
     BOOL folderWritableChecked;
+    DWORD numProcessors;     // logical processors in the current processor group
+    DWORD machineProcessors; // logical processors across all groups (job CPU rate base)
+    SYSTEM_PRESSURE pressure;
+    KILL_BREAKER breaker;
+    SCAN_ENTRY *scan;
+    DWORD scanCount;
+    DWORD scanCapacity;
+    int *scanPidTable; // open-addressing PID -> scan index, size scanPidTableSize (power of two)
+    DWORD scanPidTableSize;
+    int *scanQueue; // measurement order of the scan, then the tree aggregation queue
+    DWORD scanOrderCount; // entries of scanQueue to measure
+    DWORD scanHotCount;   // leading entries the scan budget does not apply to
+    LONGLONG scanBudgetEnd; // QueryPerformanceCounter after which optional chunks are left (0 = none)
+    DWORD tierScan;       // scans planned with TieredSampling
+    DWORD coldCursor;     // round-robin position among cold processes
+    DWORD scanColdCount;  // cold processes in this scan, 0 if none or not tiered
+    BOOL scanTiered;      // the scan was planned with TieredSampling
+    DWORD scanSampled[TIER_COUNT];
+    DWORD scanDeferred;
+    DWORD pageSize;
+    volatile LONG scanLockWaits;  // see SCAN_STATUS.lockWaits
+    volatile LONG scanLookups;
+    volatile LONG scanHeapAllocs; // see SCAN_STATUS.heapAllocs
+    DWORD scanNearLimit;
+    DWORD scanApproaching; // normal processes within AdaptiveNearPercent of a threshold or over it
+    BOOL scanMeasured;     // the last scan measured processes (not disarmed by PressureGating)
+    SCAN_COUNTERS counters;
+    LONGLONG perfFrequency; // QueryPerformanceFrequency, fixed at boot
+    TICK_SCHEDULER sched;
+    SELF_GOVERNOR governor;
+    HANDLE hWatchdogThread;
+    HEARTBEAT heartbeat;
+    volatile LONG abandonSeq; // heartbeat seq of a phase the watchdog gave up on (0 = none)
+    volatile LONG stalledPid; // process the decision stage stalled on, for NoteStalledDecision
+    PHASE_STATS phaseStats[PHASE_COUNT];
+    volatile LONG phaseStalls[PHASE_COUNT];
+    volatile LONG abandonedStages;
+    WCHAR watchdogReport[256];          // stall report the watchdog could not write itself
+    volatile LONG watchdogReportState;  // WATCHDOG_REPORT_*
+    volatile LONG watchdogReportsLost;  // reports dropped because the slot was still full
+    ARENA scanArena;
+    STRING_TABLE strings;
+    CRITICAL_SECTION csStrings; // string table lookups and insertions (not StringFromId)
+    OBJECT_POOL historyPool;
+    OBJECT_POOL balloonPool; // slots handed out under csBalloon
+    SCAN_STATUS status[2];
+    volatile LONG statusIndex;    // buffer readers should use
+    HANDLE scanWorkers[MAX_SCAN_WORKERS]; // measurement pool; the monitor thread also takes part
+    SCAN_WORKER scanWorkerState[MAX_SCAN_WORKERS + 1];
+    DWORD scanWorkerCount;
+    HANDLE hScanWorkSemaphore; // released once per worker asked to join a scan
+    HANDLE hScanDoneEvent;     // auto-reset, set by the last worker to finish
+    volatile LONG scanNextIndex; // next unclaimed g.scan index
+    volatile LONG scanWorkersBusy;
+    volatile LONG scanWorkersOrphaned; // workers still blocked in a scan MeasureScan left
+    const CONFIG *scanConfig;  // config of the scan being measured
 };
 
 static GLOBAL g = {0};
@@ -214,17 +887,36 @@ void LogErrorW(const WCHAR *format, ...);
 #define LogError LogErrorW
 BOOL IsProcessExcluded(const WCHAR *nameW, const CONFIG *cfg, const WCHAR *path);
 BOOL IsBuiltInExcluded(const WCHAR *fileName, const WCHAR *fullPath);
-PROCESS_HISTORY *FindOrCreateHistory(DWORD pid);
+static PROCESS_HISTORY *AcquireHistory(const PROCESSENTRY32W *pe, const CONFIG *cfg, PROCESS_SAMPLE *sample,
+                                       SCAN_WORKER *worker);
+static void PublishSampleHistory(PROCESS_SAMPLE *sample);
+static void PublishScanStatus(DWORD scanMs);
 void RemoveHistory(DWORD pid);
 void CleanupHistory(void);
 void ResetAllHistory(void);
-float CalcCpuUsage(HANDLE hProcess, PROCESS_HISTORY *hist);
+static void FreeHistoryNode(PROCESS_HISTORY *hist);
+static void *CountedAlloc(size_t size);
+static void *ArenaAlloc(ARENA *arena, size_t size);
+static void ArenaReset(ARENA *arena);
+static void ArenaDestroy(ARENA *arena);
+static void PoolInit(OBJECT_POOL *pool, size_t objectSize, DWORD slotsPerSlab);
+static void *PoolAlloc(OBJECT_POOL *pool);
+static void PoolFree(OBJECT_POOL *pool, void *object);
+static void PoolDestroy(OBJECT_POOL *pool);
+static STRING_ID InternString(const WCHAR *text);
+static const WCHAR *StringFromId(STRING_ID id);
+static void FreeStringTable(void);
+static BOOL ReadCpuCounters(HANDLE hProcess, PROCESS_HISTORY *hist, ULONGLONG *cpuTime, ULONGLONG *prevCpuTime,
+                            LONGLONG *stamp, LONGLONG *prevStamp);
+static float CpuPercent(ULONGLONG cpuTime, LONGLONG elapsed);
+static ULONGLONG FileTimeToUll(const FILETIME *ft);
 float CalcAverageCpuUsage(HANDLE hProcess);
 BOOL IsWindowHungFast(HWND hWnd, DWORD hangTimeoutMs);
 BOOL CALLBACK EnumHungWindowsProc(HWND hWnd, LPARAM lParam);
 HUNG_PROCESS_NODE *BuildHungProcessList(DWORD hangTimeoutMs, DWORD maxHungWindows, HANDLE stopEvent);
-void FreeHungProcessList(HUNG_PROCESS_NODE *head);
-BOOL IsProcessHung(DWORD pid, HUNG_PROCESS_NODE *hungList);
+BOOL IsProcessHung(DWORD pid, const FILETIME *createTime, HUNG_PROCESS_NODE *hungList);
+static BOOL SameCreateTime(const FILETIME *a, const FILETIME *b);
+static HANDLE OpenVerifiedProcess(DWORD access, DWORD pid, const FILETIME *createTime);
 void RotateLogIfNeeded(DWORD maxSizeBytes);
 void Cleanup(void);
 BOOL IsUserAdmin(void);
@@ -234,34 +926,86 @@ void CreateDefaultConfig(void);
 BOOL CheckConfigFileChanged(void);
 void UpdateConfigLastWrite(void);
 void GetProcessPathW(DWORD pid, WCHAR *pathBuf, DWORD bufSize);
-BOOL NtPathToDosPath(const WCHAR *ntPath, WCHAR *dosPath, DWORD dosSize);
+BOOL NtPathToDosPath(WCHAR *path);
 static WCHAR *TrimWhitespace(WCHAR *str);
 void GetExeDirectory(void);
 void GetSystemDirectories(void);
 void ExtractFileNameFromPath(const WCHAR *fullPath, WCHAR *fileName, DWORD fileNameSize);
-static BOOL OpenProcessForQuery(DWORD pid, HANDLE *phProcess, WCHAR *pathBuf, DWORD pathSize);
-static BOOL TryTerminateProcess(DWORD pid, const WCHAR *exeName, int *attempts, int *logSent);
-static void CheckNormalProcess(const PROCESSENTRY32W *pe, const CONFIG *cfg, HUNG_PROCESS_NODE *hungList);
-static void CheckSystemProcess(const PROCESSENTRY32W *pe, const CONFIG *cfg, HUNG_PROCESS_NODE *hungList);
-static void CheckProcess(const PROCESSENTRY32W *pe, const CONFIG *cfg, HUNG_PROCESS_NODE *hungList);
+static HANDLE OpenQueryHandle(DWORD pid, int memMetric);
+static STRING_ID InternImagePath(HANDLE hProcess, DWORD pid);
+static BOOL QueueTermination(PROCESS_HISTORY *hist, DWORD pid, const WCHAR *exeName, DWORD closeTimeoutMs);
+static void ProcessActionResults(void);
+DWORD WINAPI ActionThread(LPVOID lpParam);
+static void NoteViolation(void);
+static BOOL AllowTermination(int rule, const CONFIG *cfg);
+static void BeginBreakerScan(const CONFIG *cfg);
+static void EndBreakerScan(void);
+static HANDLE GetOrCreateProcessJob(PROCESS_HISTORY *hist, DWORD pid, const WCHAR *exeName);
+static BOOL TryThrottleProcess(PROCESS_HISTORY *hist, DWORD pid, const WCHAR *exeName, int action,
+                               const CONFIG *cfg, WCHAR *actionDesc, size_t descSize);
+static void LogActionEvent(const WCHAR *exeName, DWORD pid, const WCHAR *reason, const WCHAR *actionDesc,
+                           float cpu, size_t memMB, BOOL memValid, const WCHAR *path);
+static int ParseNamedValue(const WCHAR *configPath, const WCHAR *key, const WCHAR *const *names, int count, int defaultValue);
+static BOOL MeasureProcessMemory(HANDLE hProcess, const CONFIG *cfg, SCAN_WORKER *worker, size_t *memMB);
+static BOOL QueryPrivateWorkingSetMb(HANDLE hProcess, SCAN_WORKER *worker, size_t *memMB);
+static void LeakTrendAddSample(LEAK_TREND *trend, size_t memMB);
+static BOOL LeakTrendPredict(const LEAK_TREND *trend, const CONFIG *cfg, size_t memMB, double *mbPerMin, double *secondsToLimit);
+static double LeakTrendGrowthMbPerMin(const LEAK_TREND *trend);
+static void SelectMemoryVictims(const CONFIG *cfg);
+static void ReleaseMemoryCap(PROCESS_HISTORY *hist, DWORD pid, const WCHAR *exeName, const WCHAR *why);
+static BOOL CheckMemoryCapEscalation(PROCESS_HISTORY *hist, HANDLE hProcess, DWORD pid, const WCHAR *exeName,
+                                     float cpu, const CONFIG *cfg);
+static void CheckNormalProcess(const PROCESSENTRY32W *pe, const PROCESS_SAMPLE *sample, const CONFIG *cfg,
+                               HUNG_PROCESS_NODE *hungList, SCAN_ENTRY *entry);
+static void CheckSystemProcess(const PROCESSENTRY32W *pe, const PROCESS_SAMPLE *sample, const CONFIG *cfg,
+                               HUNG_PROCESS_NODE *hungList);
+static void MeasureProcess(const PROCESSENTRY32W *pe, const CONFIG *cfg, PROCESS_SAMPLE *sample, DWORD slot,
+                           SCAN_WORKER *worker);
+static DWORD ComputeScanUsage(const CONFIG *cfg);
+static BOOL MeasureScan(const CONFIG *cfg);
+static void BeginBlockingCall(SCAN_WORKER *worker, DWORD pid);
+static BOOL EndBlockingCall(SCAN_WORKER *worker);
+DWORD WINAPI ScanWorkerThread(LPVOID lpParam);
+static void CheckProcess(const PROCESSENTRY32W *pe, const PROCESS_SAMPLE *sample, const CONFIG *cfg,
+                         HUNG_PROCESS_NODE *hungList, SCAN_ENTRY *entry);
 static void ShowBalloon(const WCHAR *title, const WCHAR *text, DWORD infoFlags);
 static void UpdateTrayTooltip(void);
 static void EnsureLogFileOpen(void);
 static void CloseLogFile(void);
-static void WriteLogUTF8(const char *utf8Buffer);
+static void WriteLogUTF8(const WCHAR *text);
 static void OnPowerResume(void);
-static BOOL ShouldShowBalloonForProcess(const WCHAR *processName);
+static BOOL ShouldShowBalloonForProcess(STRING_ID nameId, const WCHAR *exeName);
 static void PeriodicBalloonCleanup(void);
-static BOOL MeasureProcessResources(HANDLE hProcess, PROCESS_HISTORY *hist, float *cpu, size_t *memMB, BOOL *memValid);
-static void FormatReason(WCHAR *buffer, size_t bufSize, float cpu, DWORD cpuThreshold,
-                         BOOL memValid, size_t memMB, DWORD memThreshold, BOOL hung);
+static int FormatReason(WCHAR *buffer, size_t bufSize, float cpu, DWORD cpuThreshold, int cpuNorm,
+                        BOOL memValid, size_t memMB, DWORD memThreshold, int memMetric, BOOL hung, DWORD skipRules);
+static DWORD GetMachineProcessorCount(void);
+static DWORD GetAllowedProcessorCount(HANDLE hProcess);
+static float CpuNormScale(DWORD allowedCores, const CONFIG *cfg);
+static float NormalizeCpu(float rawCpu, DWORD allowedCores, const CONFIG *cfg);
 static BOOL IsSystemDirectory(const WCHAR *fullPath);
 static void HandleConfigReload(ULONGLONG *lastConfigCheck, ULONGLONG *lastConfigFailBalloon);
 static void ProcessSnapshot(const CONFIG *localConfig);
+static BOOL EvaluateSystemPressure(const CONFIG *cfg);
+static ULONGLONG MonotonicMs(void);
+static void EnterPhase(int phase);
+static BOOL StageAbandoned(void);
+static void WatchdogReport(const WCHAR *text);
+static void FlushWatchdogReport(void);
+DWORD WINAPI WatchdogThread(LPVOID lpParam);
 static void SplitExcludeString(const WCHAR *input, WCHAR excludeList[MAX_EXCLUDE_COUNT][MAX_PATH_LEN], int *count, BOOL *hadWarning);
-static void CheckProcessHungAndTerminate(PROCESS_HISTORY *hist, DWORD pid, const WCHAR *exeName, HUNG_PROCESS_NODE *hungList);
-static void CheckProcessResourcesAndTerminate(PROCESS_HISTORY *hist, HANDLE hProcess, DWORD pid, const WCHAR *exeName,
-                                              const WCHAR *path, const CONFIG *cfg, HUNG_PROCESS_NODE *hungList);
+static void CheckProcessHungAndTerminate(PROCESS_HISTORY *hist, DWORD pid, const WCHAR *exeName, HUNG_PROCESS_NODE *hungList,
+                                         const CONFIG *cfg);
+static ULONGLONG GetProcessAgeMs(const PROCESS_HISTORY *hist);
+static BOOL AdvanceViolationState(PROCESS_HISTORY *hist, int level, const CONFIG *cfg);
+static DWORD ScaleThresholdForAge(DWORD threshold, ULONGLONG ageMs, int rule, const CONFIG *cfg);
+static void CheckProcessResourcesAndTerminate(const PROCESS_SAMPLE *sample, DWORD pid, const WCHAR *exeName,
+                                              const CONFIG *cfg, HUNG_PROCESS_NODE *hungList, SCAN_ENTRY *entry);
+static BOOL ApplyRuleAction(PROCESS_HISTORY *hist, DWORD pid, const WCHAR *exeName, const WCHAR *path, int rule,
+                            const WCHAR *reason, float cpu, size_t memMB, BOOL memValid, const CONFIG *cfg,
+                            int *attempts, int *logSent);
+static BOOL EnsureScanCapacity(DWORD needed);
+static void AggregateProcessTree(void);
+static void CheckProcessTrees(const CONFIG *cfg);
 static void CleanupBalloonCooldown(void);
 static void SafeLogMessageAfterUnlock(const WCHAR *format, ...);
 static void CleanupTemporaryLogFile(void);
@@ -320,6 +1064,15 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
     GetExeDirectory();
     GetSystemDirectories();
 
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    g.numProcessors = si.dwNumberOfProcessors > 0 ? si.dwNumberOfProcessors : 1;
+    g.pageSize = si.dwPageSize > 0 ? si.dwPageSize : 4096;
+    g.machineProcessors = GetMachineProcessorCount();
+    LARGE_INTEGER perfFreq;
+    QueryPerformanceFrequency(&perfFreq);
+    g.perfFrequency = perfFreq.QuadPart;
+
     CleanupTemporaryLogFile();
 
     CreateReadmeIfManualMissing();
@@ -344,9 +1097,13 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
     }
 
     InitializeCriticalSectionAndSpinCount(&g.csLog, CRITICAL_SECTION_SPIN_COUNT);
-    InitializeCriticalSectionAndSpinCount(&g.csHistory, CRITICAL_SECTION_SPIN_COUNT);
     InitializeCriticalSectionAndSpinCount(&g.csConfig, CRITICAL_SECTION_SPIN_COUNT);
     InitializeCriticalSectionAndSpinCount(&g.csBalloon, CRITICAL_SECTION_SPIN_COUNT);
+    InitializeCriticalSectionAndSpinCount(&g.csActions, CRITICAL_SECTION_SPIN_COUNT);
+    PoolInit(&g.historyPool, sizeof(PROCESS_HISTORY), HISTORY_POOL_SLAB);
+    PoolInit(&g.balloonPool, sizeof(BALLOON_COOLDOWN), BALLOON_POOL_SLAB);
+    InitializeCriticalSectionAndSpinCount(&g.csStrings, CRITICAL_SECTION_SPIN_COUNT);
+    g.strings.count = 1; // STRING_ID_NONE
 
     BOOL configLoaded = LoadConfig();
     if (!configLoaded)
@@ -363,6 +1120,62 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
             defaultConfig.logMaxSizeBytes = DEFAULT_LOG_MAX_SIZE_BYTES;
             defaultConfig.maxHungWindows = DEFAULT_MAX_HUNG_WINDOWS;
             defaultConfig.notifyOnTermination = DEFAULT_NOTIFY_ON_TERMINATION;
+            for (int r = 0; r < RULE_COUNT; r++)
+                defaultConfig.ruleAction[r] = ACTION_TERMINATE;
+            defaultConfig.ruleGraceSec[RULE_CPU] = DEFAULT_CPU_GRACE_SEC;
+            defaultConfig.ruleGraceSec[RULE_MEM] = DEFAULT_MEM_GRACE_SEC;
+            defaultConfig.ruleGraceSec[RULE_HANG] = DEFAULT_HANG_GRACE_SEC;
+            defaultConfig.ruleCloseTimeoutMs[RULE_CPU] = DEFAULT_CPU_CLOSE_TIMEOUT_MS;
+            defaultConfig.ruleCloseTimeoutMs[RULE_MEM] = DEFAULT_MEM_CLOSE_TIMEOUT_MS;
+            defaultConfig.ruleCloseTimeoutMs[RULE_HANG] = DEFAULT_HANG_CLOSE_TIMEOUT_MS;
+            defaultConfig.ageRampSec = DEFAULT_AGE_RAMP_SEC;
+            defaultConfig.ageThresholdScalePercent = DEFAULT_AGE_THRESHOLD_SCALE_PERCENT;
+            defaultConfig.hysteresisExitPercent = DEFAULT_HYSTERESIS_EXIT_PERCENT;
+            defaultConfig.violationDwellMs = DEFAULT_VIOLATION_DWELL_MS;
+            defaultConfig.recoveryDwellMs = DEFAULT_RECOVERY_DWELL_MS;
+            defaultConfig.killRatePerMinute = DEFAULT_KILL_RATE_PER_MINUTE;
+            for (int r = 0; r < RULE_COUNT; r++)
+                defaultConfig.ruleKillRatePerMinute[r] = DEFAULT_RULE_KILL_RATE_PER_MINUTE;
+            defaultConfig.stormThreshold = DEFAULT_STORM_THRESHOLD;
+            defaultConfig.throttleAffinityCores = DEFAULT_THROTTLE_AFFINITY_CORES;
+            defaultConfig.cpuRateCapPercent = DEFAULT_CPU_RATE_CAP_PERCENT;
+            defaultConfig.throttleIdlePriority = DEFAULT_THROTTLE_IDLE_PRIORITY;
+            defaultConfig.memCapCommitLimitMb = DEFAULT_MEM_CAP_COMMIT_LIMIT_MB;
+            defaultConfig.memCapEscalateMs = DEFAULT_MEM_CAP_ESCALATE_MS;
+            defaultConfig.memMetric = MEM_METRIC_WORKING_SET;
+            defaultConfig.cpuNormalization = CPU_NORM_CORE;
+            defaultConfig.pressureGating = DEFAULT_PRESSURE_GATING;
+            defaultConfig.pressureCpuPercent = DEFAULT_PRESSURE_CPU_PERCENT;
+            defaultConfig.pressureMemoryPercent = DEFAULT_PRESSURE_MEMORY_PERCENT;
+            defaultConfig.pressureCommitPercent = DEFAULT_PRESSURE_COMMIT_PERCENT;
+            defaultConfig.victimSelection = DEFAULT_VICTIM_SELECTION;
+            defaultConfig.victimMaxPerScan = DEFAULT_VICTIM_MAX_PER_SCAN;
+            defaultConfig.cpuSaturationPercent = DEFAULT_CPU_SATURATION_PERCENT;
+            defaultConfig.leakDetection = DEFAULT_LEAK_DETECTION;
+            defaultConfig.leakHorizonSec = DEFAULT_LEAK_HORIZON_SEC;
+            defaultConfig.leakMinSamples = DEFAULT_LEAK_MIN_SAMPLES;
+            defaultConfig.leakMinGrowthMbPerMin = DEFAULT_LEAK_MIN_GROWTH_MB_PER_MIN;
+            defaultConfig.treeAggregation = DEFAULT_TREE_AGGREGATION;
+            defaultConfig.treeCpuThresholdPercent = DEFAULT_TREE_CPU_THRESHOLD_PERCENT;
+            defaultConfig.treeMemThresholdMb = DEFAULT_TREE_MEM_THRESHOLD_MB;
+            defaultConfig.scanWorkers = DEFAULT_SCAN_WORKERS;
+            defaultConfig.overrunPolicy = OVERRUN_SKIP;
+            defaultConfig.startStaggerMs = DEFAULT_START_STAGGER_MS;
+            defaultConfig.adaptiveInterval = DEFAULT_ADAPTIVE_INTERVAL;
+            defaultConfig.adaptiveMinIntervalMs = DEFAULT_ADAPTIVE_MIN_INTERVAL_MS;
+            defaultConfig.adaptiveMaxIntervalMs = DEFAULT_ADAPTIVE_MAX_INTERVAL_MS;
+            defaultConfig.adaptiveNearPercent = DEFAULT_ADAPTIVE_NEAR_PERCENT;
+            defaultConfig.tieredSampling = DEFAULT_TIERED_SAMPLING;
+            defaultConfig.backgroundMode = DEFAULT_BACKGROUND_MODE;
+            defaultConfig.selfCpuBudgetPercent = DEFAULT_SELF_CPU_BUDGET_PERCENT;
+            defaultConfig.selfMemoryBudgetMb = DEFAULT_SELF_MEMORY_BUDGET_MB;
+            defaultConfig.watchdogStallMs = DEFAULT_WATCHDOG_STALL_MS;
+            defaultConfig.tierHotPercent = DEFAULT_TIER_HOT_PERCENT;
+            defaultConfig.tierWarmPercent = DEFAULT_TIER_WARM_PERCENT;
+            defaultConfig.tierWarmEvery = DEFAULT_TIER_WARM_EVERY;
+            defaultConfig.tierColdBatch = DEFAULT_TIER_COLD_BATCH;
+            defaultConfig.scanBudgetProcesses = DEFAULT_SCAN_BUDGET_PROCESSES;
+            defaultConfig.scanBudgetUs = DEFAULT_SCAN_BUDGET_US;
             defaultConfig.excludeCount = 0;
             defaultConfig.monitoringDefault = 1;
             EnterCriticalSection(&g.csConfig);
@@ -415,6 +1228,21 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
              InterlockedCompareExchange(&g.monitorActive, 0, 0) ? L"ON" : L"OFF");
     ShowBalloon(L"Process Monitor", startupMsg, NIIF_INFO);
 
+    g.hActionEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    g.hActionThread = g.hActionEvent ? CreateThread(NULL, 0, ActionThread, NULL, 0, NULL) : NULL;
+    if (!g.hActionThread)
+    {
+        LogError(L"Failed to start action executor thread");
+        RemoveTrayIcon();
+        DestroyWindow(g.hWnd);
+        goto cleanup;
+    }
+
+    // Scan workers are started on demand by MeasureScan; without these objects every
+    // scan is simply measured on the monitor thread.
+    g.hScanWorkSemaphore = CreateSemaphore(NULL, 0, MAX_SCAN_WORKERS, NULL);
+    g.hScanDoneEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+
     g.hMonitorThread = CreateThread(NULL, 0, MonitorThread, NULL, 0, NULL);
     if (!g.hMonitorThread)
     {
@@ -423,6 +1251,10 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
         DestroyWindow(g.hWnd);
         goto cleanup;
     }
+    // Monitoring works without it; stalls just go unreported.
+    g.hWatchdogThread = CreateThread(NULL, 0, WatchdogThread, NULL, 0, NULL);
+    if (!g.hWatchdogThread)
+        LogError(L"Failed to start watchdog thread (err %lu)", GetLastError());
 
     MSG msg;
     while (GetMessage(&msg, NULL, 0, 0))
@@ -656,19 +1488,284 @@ static void CheckFolderWritable(void)
     }
 }
 
-// -------------------- Balloon Cooldown Management --------------------
-static BOOL ShouldShowBalloonForProcess(const WCHAR *processName)
+// -------------------- Scan Arena and Object Pools --------------------
+// malloc that counts against the current scan (SCAN_STATUS.heapAllocs).
+static void *CountedAlloc(size_t size)
+{
+    InterlockedIncrement(&g.scanHeapAllocs);
+    return malloc(size);
+}
+
+static void *ArenaAlloc(ARENA *arena, size_t size)
+{
+    size = ALIGN_ALLOC(size);
+    ARENA_BLOCK *block = arena->head;
+    if (!block || block->size - block->used < size)
+    {
+        size_t blockSize = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        block = (ARENA_BLOCK *)CountedAlloc(ALIGN_ALLOC(sizeof(ARENA_BLOCK)) + blockSize);
+        if (!block)
+            return NULL;
+        block->next = arena->head;
+        block->size = blockSize;
+        block->used = 0;
+        arena->head = block;
+    }
+    void *p = (BYTE *)block + ALIGN_ALLOC(sizeof(ARENA_BLOCK)) + block->used;
+    block->used += size;
+    return p;
+}
+
+// Invalidates everything allocated since the last reset.
+static void ArenaReset(ARENA *arena)
+{
+    ARENA_BLOCK *block = arena->head;
+    if (!block)
+        return;
+    if (!block->next)
+    {
+        block->used = 0;
+        return;
+    }
+
+    // The scan outgrew the arena: replace the chain with one block of the combined size.
+    size_t total = 0;
+    while (block)
+    {
+        ARENA_BLOCK *next = block->next;
+        total += block->size;
+        free(block);
+        block = next;
+    }
+    arena->head = NULL;
+    block = (ARENA_BLOCK *)CountedAlloc(ALIGN_ALLOC(sizeof(ARENA_BLOCK)) + total);
+    if (block)
+    {
+        block->next = NULL;
+        block->size = total;
+        block->used = 0;
+        arena->head = block;
+    }
+}
+
+static void ArenaDestroy(ARENA *arena)
+{
+    while (arena->head)
+    {
+        ARENA_BLOCK *next = arena->head->next;
+        free(arena->head);
+        arena->head = next;
+    }
+}
+
+static void PoolInit(OBJECT_POOL *pool, size_t objectSize, DWORD slotsPerSlab)
+{
+    InitializeSListHead(&pool->freeSlots);
+    InitializeSListHead(&pool->slabs);
+    pool->slotSize = ALIGN_ALLOC(objectSize > sizeof(SLIST_ENTRY) ? objectSize : sizeof(SLIST_ENTRY));
+    pool->slotsPerSlab = slotsPerSlab;
+}
+
+// Returns an uninitialized slot, adding a slab when the pool is empty. Any thread; two
+// threads that find the pool empty at the same time simply add a slab each.
+static void *PoolAlloc(OBJECT_POOL *pool)
+{
+    PSLIST_ENTRY slot = InterlockedPopEntrySList(&pool->freeSlots);
+    if (slot)
+        return slot;
+
+    size_t header = ALIGN_ALLOC(sizeof(SLIST_ENTRY));
+    BYTE *slab = (BYTE *)_aligned_malloc(header + pool->slotSize * pool->slotsPerSlab, MEMORY_ALLOCATION_ALIGNMENT);
+    if (!slab)
+        return NULL;
+    InterlockedIncrement(&g.scanHeapAllocs);
+    InterlockedPushEntrySList(&pool->slabs, (PSLIST_ENTRY)slab);
+    // The first slot goes to the caller, the rest to the free list.
+    for (DWORD i = 1; i < pool->slotsPerSlab; i++)
+        InterlockedPushEntrySList(&pool->freeSlots, (PSLIST_ENTRY)(slab + header + i * pool->slotSize));
+    return slab + header;
+}
+
+static void PoolFree(OBJECT_POOL *pool, void *object)
+{
+    if (object)
+        InterlockedPushEntrySList(&pool->freeSlots, (PSLIST_ENTRY)object);
+}
+
+// Releases every slab. Slots still in use become invalid.
+static void PoolDestroy(OBJECT_POOL *pool)
+{
+    PSLIST_ENTRY slab = InterlockedFlushSList(&pool->slabs);
+    while (slab)
+    {
+        PSLIST_ENTRY next = slab->Next;
+        _aligned_free(slab);
+        slab = next;
+    }
+    InitializeSListHead(&pool->freeSlots);
+}
+
+// Enters a lock the scan shares with other threads, counting the times it was
+// already held (SCAN_STATUS.lockWaits).
+static void EnterSharedLock(CRITICAL_SECTION *cs)
+{
+    if (!TryEnterCriticalSection(cs))
+    {
+        InterlockedIncrement(&g.scanLockWaits);
+        EnterCriticalSection(cs);
+    }
+}
+
+// -------------------- String Interning --------------------
+static DWORD FoldedHash(const WCHAR *text, DWORD *length)
+{
+    DWORD hash = 2166136261u; // FNV-1a
+    DWORD n = 0;
+    for (; text[n] != L'\0'; n++)
+    {
+        WCHAR c = text[n];
+        if (c >= L'A' && c <= L'Z')
+            c += L'a' - L'A';
+        hash = (hash ^ c) * 16777619u;
+    }
+    *length = n;
+    return hash;
+}
+
+static BOOL FoldedEqual(const WCHAR *a, const WCHAR *b, DWORD length)
+{
+    for (DWORD i = 0; i < length; i++)
+    {
+        WCHAR x = a[i], y = b[i];
+        if (x >= L'A' && x <= L'Z')
+            x += L'a' - L'A';
+        if (y >= L'A' && y <= L'Z')
+            y += L'a' - L'A';
+        if (x != y)
+            return FALSE;
+    }
+    return TRUE;
+}
+
+static INTERN_ENTRY *InternEntry(STRING_ID id)
+{
+    return &g.strings.chunks[id / INTERN_CHUNK_SIZE][id % INTERN_CHUNK_SIZE];
+}
+
+static const WCHAR *StringFromId(STRING_ID id)
+{
+    return id == STRING_ID_NONE ? L"" : InternEntry(id)->text;
+}
+
+// Doubles the hash slots and reinserts every ID. Caller holds csStrings.
+static BOOL GrowStringSlots(void)
 {
-    if (processName == NULL || processName[0] == L'\0')
+    STRING_TABLE *t = &g.strings;
+    DWORD newCount = t->slotCount ? t->slotCount * 2 : INTERN_INITIAL_SLOTS;
+    InterlockedIncrement(&g.scanHeapAllocs);
+    STRING_ID *slots = (STRING_ID *)calloc(newCount, sizeof(STRING_ID));
+    if (!slots)
         return FALSE;
+    for (STRING_ID id = 1; id < (STRING_ID)t->count; id++)
+    {
+        DWORD i = InternEntry(id)->hash & (newCount - 1);
+        while (slots[i] != STRING_ID_NONE)
+            i = (i + 1) & (newCount - 1);
+        slots[i] = id;
+    }
+    free(t->slots);
+    t->slots = slots;
+    t->slotCount = newCount;
+    return TRUE;
+}
+
+// Returns the ID of text, adding it on first use. Any thread. STRING_ID_NONE for an
+// empty string, or if the table is full or out of memory.
+static STRING_ID InternString(const WCHAR *text)
+{
+    if (!text || text[0] == L'\0')
+        return STRING_ID_NONE;
+    DWORD length;
+    DWORD hash = FoldedHash(text, &length);
+
+    EnterSharedLock(&g.csStrings);
+    STRING_TABLE *t = &g.strings;
+    STRING_ID id = STRING_ID_NONE;
+    DWORD mask = t->slotCount - 1;
+    for (DWORD i = hash & mask; t->slotCount && t->slots[i] != STRING_ID_NONE; i = (i + 1) & mask)
+    {
+        const INTERN_ENTRY *e = InternEntry(t->slots[i]);
+        if (e->hash == hash && e->length == length && FoldedEqual(e->text, text, length))
+        {
+            id = t->slots[i];
+            break;
+        }
+    }
+
+    STRING_ID next = (STRING_ID)t->count;
+    BOOL logFull = FALSE;
+    if (id == STRING_ID_NONE && next >= INTERN_CHUNK_SIZE * INTERN_MAX_CHUNKS && !t->fullLogged)
+    {
+        t->fullLogged = TRUE;
+        logFull = TRUE;
+    }
+    if (id == STRING_ID_NONE && next < INTERN_CHUNK_SIZE * INTERN_MAX_CHUNKS &&
+        ((next + 1) * 2 <= t->slotCount || GrowStringSlots()))
+    {
+        INTERN_ENTRY **chunk = &t->chunks[next / INTERN_CHUNK_SIZE];
+        if (!*chunk)
+            *chunk = (INTERN_ENTRY *)CountedAlloc(INTERN_CHUNK_SIZE * sizeof(INTERN_ENTRY));
+        WCHAR *copy = *chunk ? (WCHAR *)ArenaAlloc(&t->text, (length + 1) * sizeof(WCHAR)) : NULL;
+        if (copy)
+        {
+            memcpy(copy, text, (length + 1) * sizeof(WCHAR));
+            INTERN_ENTRY *e = &(*chunk)[next % INTERN_CHUNK_SIZE];
+            e->text = copy;
+            e->hash = hash;
+            e->length = length;
+            DWORD i = hash & (t->slotCount - 1);
+            while (t->slots[i] != STRING_ID_NONE)
+                i = (i + 1) & (t->slotCount - 1);
+            t->slots[i] = next;
+            InterlockedExchange(&t->count, (LONG)next + 1);
+            id = next;
+        }
+    }
+    LeaveCriticalSection(&g.csStrings);
+    if (logFull)
+        LogMessage(L"String table is full (%u names and paths); new names are no longer interned.",
+                   (unsigned)(INTERN_CHUNK_SIZE * INTERN_MAX_CHUNKS));
+    return id;
+}
+
+static void FreeStringTable(void)
+{
+    for (int i = 0; i < INTERN_MAX_CHUNKS; i++)
+    {
+        free(g.strings.chunks[i]);
+        g.strings.chunks[i] = NULL;
+    }
+    free(g.strings.slots);
+    g.strings.slots = NULL;
+    g.strings.slotCount = 0;
+    g.strings.count = 1;
+    g.strings.fullLogged = FALSE;
+    ArenaDestroy(&g.strings.text);
+}
 
+// -------------------- Balloon Cooldown Management --------------------
+// nameId is the interned exeName. If the string table could not hold the name, the
+// cooldown is keyed on a copy of the name instead, so such processes are still
+// rate-limited.
+static BOOL ShouldShowBalloonForProcess(STRING_ID nameId, const WCHAR *exeName)
+{
     ULONGLONG now = GetTickCount64();
     EnterCriticalSection(&g.csBalloon);
 
     BALLOON_COOLDOWN *curr = g.balloonCooldown;
     while (curr)
     {
-        if (_wcsicmp(curr->processName, processName) == 0)
+        if (curr->nameId == nameId && (nameId != STRING_ID_NONE || _wcsicmp(curr->rawName, exeName) == 0))
         {
             if (now - curr->lastTick < SUSPICIOUS_BALLOON_COOLDOWN_MS)
             {
@@ -682,10 +1779,17 @@ static BOOL ShouldShowBalloonForProcess(const WCHAR *processName)
         curr = curr->next;
     }
 
-    BALLOON_COOLDOWN *newNode = (BALLOON_COOLDOWN *)malloc(sizeof(BALLOON_COOLDOWN));
+    BALLOON_COOLDOWN *newNode = (BALLOON_COOLDOWN *)PoolAlloc(&g.balloonPool);
+    WCHAR *rawName = NULL;
+    if (newNode && nameId == STRING_ID_NONE && !(rawName = _wcsdup(exeName)))
+    {
+        PoolFree(&g.balloonPool, newNode);
+        newNode = NULL;
+    }
     if (newNode)
     {
-        wcsncpy_s(newNode->processName, MAX_PATH_LEN, processName, _TRUNCATE);
+        newNode->nameId = nameId;
+        newNode->rawName = rawName;
         newNode->lastTick = now;
         newNode->next = g.balloonCooldown;
         g.balloonCooldown = newNode;
@@ -708,7 +1812,8 @@ static void PeriodicBalloonCleanup(void)
         if (now - curr->lastTick > SUSPICIOUS_BALLOON_COOLDOWN_MS)
         {
             *prev = curr->next;
-            free(curr);
+            free(curr->rawName);
+            PoolFree(&g.balloonPool, curr);
             curr = *prev;
         }
         else
@@ -729,7 +1834,8 @@ static void CleanupBalloonCooldown(void)
     {
         BALLOON_COOLDOWN *tmp = curr;
         curr = curr->next;
-        free(tmp);
+        free(tmp->rawName);
+        PoolFree(&g.balloonPool, tmp);
     }
     g.balloonCooldown = NULL;
     LeaveCriticalSection(&g.csBalloon);
@@ -743,9 +1849,10 @@ static void OnPowerResume(void)
 }
 
 // -------------------- NT Path to DOS Path Conversion --------------------
-BOOL NtPathToDosPath(const WCHAR *ntPath, WCHAR *dosPath, DWORD dosSize)
+// Rewrites an NT device path (\\Device\\HarddiskVolume2\\...) as a drive-letter path in place.
+BOOL NtPathToDosPath(WCHAR *path)
 {
-    if (!ntPath || !dosPath || dosSize == 0)
+    if (!path)
         return FALSE;
 
     WCHAR drives[256];
@@ -756,14 +1863,17 @@ BOOL NtPathToDosPath(const WCHAR *ntPath, WCHAR *dosPath, DWORD dosSize)
     WCHAR *drive = drives;
     while (*drive)
     {
-        WCHAR driveRoot[4] = {drive[0], drive[1], L'\\', L'\0'};
-        WCHAR targetPath[INTERNAL_PATH_BUFFER_SIZE];
-        if (QueryDosDeviceW(driveRoot, targetPath, INTERNAL_PATH_BUFFER_SIZE))
+        WCHAR deviceName[3] = {drive[0], drive[1], L'\0'};
+        WCHAR targetPath[MAX_PATH_LEN];
+        if (QueryDosDeviceW(deviceName, targetPath, MAX_PATH_LEN))
         {
             size_t targetLen = wcslen(targetPath);
-            if (_wcsnicmp(ntPath, targetPath, targetLen) == 0)
+            if (targetLen >= 2 && _wcsnicmp(path, targetPath, targetLen) == 0 && path[targetLen] == L'\\')
             {
-                _snwprintf_s(dosPath, dosSize, _TRUNCATE, L"%s%s", driveRoot, ntPath + targetLen);
+                // "C:" is never longer than the device name it replaces.
+                memmove(path + 2, path + targetLen, (wcslen(path + targetLen) + 1) * sizeof(WCHAR));
+                path[0] = drive[0];
+                path[1] = drive[1];
                 return TRUE;
             }
         }
@@ -774,46 +1884,26 @@ BOOL NtPathToDosPath(const WCHAR *ntPath, WCHAR *dosPath, DWORD dosSize)
 
 void GetProcessPathW(DWORD pid, WCHAR *pathBuf, DWORD bufSize)
 {
-    WCHAR internalPath[INTERNAL_PATH_BUFFER_SIZE];
+    pathBuf[0] = L'\0';
     HANDLE hProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
     if (hProcess)
     {
-        DWORD size = INTERNAL_PATH_BUFFER_SIZE;
-        if (QueryFullProcessImageNameW(hProcess, 0, internalPath, &size))
-        {
-            wcsncpy_s(pathBuf, bufSize, internalPath, _TRUNCATE);
-            CloseHandle(hProcess);
-            return;
-        }
+        DWORD size = bufSize;
+        BOOL ok = QueryFullProcessImageNameW(hProcess, 0, pathBuf, &size);
         CloseHandle(hProcess);
+        if (ok)
+            return;
     }
 
     hProcess = OpenProcess(PROCESS_QUERY_INFORMATION, FALSE, pid);
     if (hProcess)
     {
-        DWORD len = GetProcessImageFileNameW(hProcess, internalPath, INTERNAL_PATH_BUFFER_SIZE);
-        if (len > 0)
-        {
-            WCHAR dosPath[INTERNAL_PATH_BUFFER_SIZE];
-            if (NtPathToDosPath(internalPath, dosPath, INTERNAL_PATH_BUFFER_SIZE))
-            {
-                wcsncpy_s(pathBuf, bufSize, dosPath, _TRUNCATE);
-            }
-            else
-            {
-                wcsncpy_s(pathBuf, bufSize, internalPath, _TRUNCATE);
-            }
-        }
+        if (GetProcessImageFileNameW(hProcess, pathBuf, bufSize) > 0)
+            NtPathToDosPath(pathBuf); // left as the NT path if no drive matches
         else
-        {
             pathBuf[0] = L'\0';
-        }
         CloseHandle(hProcess);
     }
-    else
-    {
-        pathBuf[0] = L'\0';
-    }
 }
 
 void ExtractFileNameFromPath(const WCHAR *fullPath, WCHAR *fileName, DWORD fileNameSize)
@@ -878,149 +1968,379 @@ static BOOL IsSystemDirectory(const WCHAR *fullPath)
 }
 
 // -------------------- Process History Management --------------------
-PROCESS_HISTORY *FindOrCreateHistory(DWORD pid)
+static void FreeHistoryNode(PROCESS_HISTORY *hist)
 {
-    EnterCriticalSection(&g.csHistory);
-    PROCESS_HISTORY **prev = &g.history;
-    PROCESS_HISTORY *curr = g.history;
-    while (curr)
+    // Closing the job handle does not release the process: limits stay in
+    // effect for as long as the process lives.
+    if (hist->hJob)
+        CloseHandle(hist->hJob);
+    if (hist->hQuery)
+        CloseHandle(hist->hQuery);
+    PoolFree(&g.historyPool, hist);
+}
+
+// Processes are identified by (PID, creation time). A zero creation time means "unknown"
+// and matches anything, so processes we cannot query still work by PID alone.
+static BOOL SameCreateTime(const FILETIME *a, const FILETIME *b)
+{
+    if (!a || !b || (a->dwLowDateTime == 0 && a->dwHighDateTime == 0) ||
+        (b->dwLowDateTime == 0 && b->dwHighDateTime == 0))
+        return TRUE;
+    return a->dwLowDateTime == b->dwLowDateTime && a->dwHighDateTime == b->dwHighDateTime;
+}
+
+// Opens a process for an action and checks that the PID still belongs to the process
+// created at createTime. Fails with ERROR_INVALID_PARAMETER (as for an exited process)
+// if the PID has been reused.
+static HANDLE OpenVerifiedProcess(DWORD access, DWORD pid, const FILETIME *createTime)
+{
+    HANDLE hProcess = OpenProcess(access | PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+    if (hProcess == NULL)
+        return NULL;
+
+    FILETIME ftCreate, ftExit, ftKernel, ftUser;
+    if (!GetProcessTimes(hProcess, &ftCreate, &ftExit, &ftKernel, &ftUser) || !SameCreateTime(&ftCreate, createTime))
+    {
+        CloseHandle(hProcess);
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return NULL;
+    }
+    return hProcess;
+}
+
+static HISTORY_SHARD *HistoryShard(DWORD pid)
+{
+    // PIDs are multiples of 4, so drop the low bits to use every shard.
+    return &g.historyShards[(pid >> 2) & (HISTORY_SHARD_COUNT - 1)];
+}
+
+// Each record owns a query handle for its process, opened once and reused every scan
+// until the process leaves the snapshot. Holding the handle also keeps Windows from
+// handing the PID to a new process, so a cached record always refers to the process it
+// was created for. Processes that cannot be opened are retried only every
+// QUERY_HANDLE_RETRY_MS; if one later opens, the record starts fresh, since its
+// identity was never known. Such a record does not pin its PID either, so it is only
+// reused while the snapshot still shows the same parent PID and image name.
+// Runs on scan workers without locks: lists are not modified during measurement, each
+// PID is measured by exactly one worker, and a new record is returned unlinked in
+// sample->hist (sample->histPending) for PublishSampleHistory. Returns NULL if MeasureScan
+// left the worker behind while it was opening the process.
+static PROCESS_HISTORY *AcquireHistory(const PROCESSENTRY32W *pe, const CONFIG *cfg, PROCESS_SAMPLE *sample,
+                                       SCAN_WORKER *worker)
+{
+    DWORD pid = pe->th32ProcessID;
+    ULONGLONG now = GetTickCount64();
+    PROCESS_HISTORY *stale = NULL;
+    BOOL reused = FALSE; // stale belongs to an earlier process with the same PID
+
+    InterlockedIncrement(&g.scanLookups);
+    for (PROCESS_HISTORY *curr = HistoryShard(pid)->head; curr != NULL; curr = curr->next)
     {
         if (curr->pid == pid)
         {
             curr->seen = TRUE;
-            LeaveCriticalSection(&g.csHistory);
-            return curr;
+            if (curr->hQuery)
+                return curr;
+            reused = curr->parentPid != pe->th32ParentProcessID || _wcsicmp(StringFromId(curr->nameId), pe->szExeFile) != 0;
+            if (!reused && now - curr->queryOpenFailTick < QUERY_HANDLE_RETRY_MS)
+                return curr;
+            stale = curr;
+            break;
         }
-        prev = &curr->next;
-        curr = curr->next;
     }
 
-    PROCESS_HISTORY *newHist = (PROCESS_HISTORY *)malloc(sizeof(PROCESS_HISTORY));
+    DWORD parentPid = pe->th32ParentProcessID;
+    STRING_ID nameId = InternString(pe->szExeFile);
+
+    // Opening a process can hang (for example while it is being torn down). Until
+    // EndBlockingCall only locals and the unlinked new record are touched, since pe,
+    // stale and sample may be gone once MeasureScan stops waiting for this worker.
+    BeginBlockingCall(worker, pid);
+    HANDLE hProcess = OpenQueryHandle(pid, cfg->memMetric);
+    PROCESS_HISTORY *newHist = NULL;
+    if (!stale || hProcess || reused)
+        newHist = (PROCESS_HISTORY *)PoolAlloc(&g.historyPool);
     if (newHist)
     {
         memset(newHist, 0, sizeof(PROCESS_HISTORY));
         newHist->pid = pid;
+        newHist->parentPid = parentPid;
         newHist->seen = TRUE;
-
-        HANDLE hProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+        newHist->hQuery = hProcess;
         if (hProcess)
         {
-            FILETIME ftCreate, ftExit, ftKernel, ftUser;
-            if (GetProcessTimes(hProcess, &ftCreate, &ftExit, &ftKernel, &ftUser))
-            {
-                newHist->ftCreate = ftCreate;
-                newHist->ftKernel = ftKernel;
-                newHist->ftUser = ftUser;
+            FILETIME ftExit;
+            if (GetProcessTimes(hProcess, &newHist->ftCreate, &ftExit, &newHist->ftKernel, &newHist->ftUser))
                 QueryPerformanceCounter(&newHist->perfTime);
-            }
-            CloseHandle(hProcess);
         }
+        else
+        {
+            newHist->queryOpenFailTick = now;
+        }
+        newHist->nameId = nameId;
+        newHist->pathId = InternImagePath(hProcess, pid);
+    }
+    if (!EndBlockingCall(worker))
+    {
+        if (hProcess)
+            CloseHandle(hProcess);
+        if (newHist)
+            PoolFree(&g.historyPool, newHist);
+        return NULL;
+    }
 
-        newHist->next = g.history;
-        g.history = newHist;
+    if (stale && !hProcess && !reused)
+    {
+        stale->queryOpenFailTick = now;
+        return stale;
+    }
+    if (!newHist)
+    {
+        if (hProcess)
+            CloseHandle(hProcess);
+        return reused ? NULL : stale;
     }
-    LeaveCriticalSection(&g.csHistory);
+
+    sample->histPending = TRUE;
+    sample->histStale = stale;
     return newHist;
 }
 
+// Finds the record of a PID without creating one. Monitor thread only, outside measurement.
+static PROCESS_HISTORY *LookupHistory(DWORD pid)
+{
+    g.scanLookups++;
+    for (PROCESS_HISTORY *curr = HistoryShard(pid)->head; curr != NULL; curr = curr->next)
+    {
+        if (curr->pid == pid)
+            return curr;
+    }
+    return NULL;
+}
+
+// Links a record created by AcquireHistory. Monitor thread only, after measurement.
+static void PublishSampleHistory(PROCESS_SAMPLE *sample)
+{
+    if (!sample->histPending)
+        return;
+    HISTORY_SHARD *shard = HistoryShard(sample->hist->pid);
+    if (sample->histStale)
+    {
+        for (PROCESS_HISTORY **prev = &shard->head; *prev != NULL; prev = &(*prev)->next)
+        {
+            if (*prev == sample->histStale)
+            {
+                *prev = sample->histStale->next;
+                break;
+            }
+        }
+        FreeHistoryNode(sample->histStale);
+        sample->histStale = NULL;
+    }
+    sample->hist->next = shard->head;
+    shard->head = sample->hist;
+    sample->histPending = FALSE;
+}
+
 void RemoveHistory(DWORD pid)
 {
-    EnterCriticalSection(&g.csHistory);
-    PROCESS_HISTORY **prev = &g.history;
-    PROCESS_HISTORY *curr = g.history;
+    HISTORY_SHARD *shard = HistoryShard(pid);
+    PROCESS_HISTORY **prev = &shard->head;
+    PROCESS_HISTORY *curr = shard->head;
     while (curr)
     {
         if (curr->pid == pid)
         {
             *prev = curr->next;
-            free(curr);
+            FreeHistoryNode(curr);
             break;
         }
         prev = &curr->next;
         curr = curr->next;
     }
-    LeaveCriticalSection(&g.csHistory);
 }
 
+// Drops records not seen by this scan and clears the flag on the rest for the next one.
 void CleanupHistory(void)
 {
-    EnterCriticalSection(&g.csHistory);
-    PROCESS_HISTORY **prev = &g.history;
-    PROCESS_HISTORY *curr = g.history;
-    while (curr)
+    for (int i = 0; i < HISTORY_SHARD_COUNT; i++)
     {
-        if (!curr->seen)
-        {
-            *prev = curr->next;
-            free(curr);
-            curr = *prev;
-        }
-        else
+        PROCESS_HISTORY **prev = &g.historyShards[i].head;
+        PROCESS_HISTORY *curr = *prev;
+        while (curr)
         {
-            curr->seen = FALSE;
-            prev = &curr->next;
-            curr = curr->next;
+            if (!curr->seen)
+            {
+                *prev = curr->next;
+                FreeHistoryNode(curr);
+                curr = *prev;
+            }
+            else
+            {
+                curr->seen = FALSE;
+                prev = &curr->next;
+                curr = curr->next;
+            }
         }
     }
-    LeaveCriticalSection(&g.csHistory);
 }
 
 void ResetAllHistory(void)
 {
-    EnterCriticalSection(&g.csHistory);
-    PROCESS_HISTORY *curr = g.history;
-    while (curr)
+    for (int i = 0; i < HISTORY_SHARD_COUNT; i++)
     {
-        PROCESS_HISTORY *tmp = curr;
-        curr = curr->next;
-        free(tmp);
+        PROCESS_HISTORY *curr = g.historyShards[i].head;
+        while (curr)
+        {
+            PROCESS_HISTORY *tmp = curr;
+            curr = curr->next;
+            FreeHistoryNode(tmp);
+        }
+        g.historyShards[i].head = NULL;
     }
-    g.history = NULL;
-    LeaveCriticalSection(&g.csHistory);
 }
 
-// -------------------- CPU Usage Calculation (using QPC) --------------------
-float CalcCpuUsage(HANDLE hProcess, PROCESS_HISTORY *hist)
+// Publishes the summary of the scan that just finished (see SCAN_STATUS).
+static void PublishScanStatus(DWORD scanMs)
 {
-    if (hProcess == NULL)
-        return -1.0f;
-    FILETIME ftCreate, ftExit, ftKernel, ftUser;
-    if (!GetProcessTimes(hProcess, &ftCreate, &ftExit, &ftKernel, &ftUser))
+    SCAN_STATUS *st = &g.status[(g.statusIndex + 1) & 1];
+    InterlockedIncrement(&st->seq);
+
+    st->scanTick = GetTickCount64();
+    st->scanMs = scanMs;
+    st->processCount = g.scanCount;
+    st->historyLookups = (DWORD)g.scanLookups;
+    st->lockWaits = g.scanLockWaits;
+    st->heapAllocs = g.scanHeapAllocs;
+    st->nearLimitCount = g.scanNearLimit;
+    st->ticks = g.sched.ticks;
+    st->overruns = g.sched.overruns;
+    st->skippedTicks = g.sched.skippedTicks;
+    st->lateAvgMs = g.sched.ticks ? (DWORD)(g.sched.lateSumMs / g.sched.ticks) : 0;
+    st->lateMaxMs = g.sched.lateMaxMs;
+    st->intervalMs = g.sched.intervalMs;
+    st->shortened = g.sched.shortened;
+    st->lengthened = g.sched.lengthened;
+    st->cpuMsPerHour = g.sched.cpuMsPerHour;
+    st->tickCpuMs = g.sched.tickCpuMs;
+    st->tickCpuMaxMs = g.sched.tickCpuMaxMs;
+    st->selfMemMB = g.sched.selfMemMB;
+    st->governorLevel = g.governor.level;
+    st->governedTicks = g.governor.governedTicks;
+    st->stalls = 0;
+    st->slowestPhase = PHASE_WAIT;
+    st->slowestPhaseMs = 0;
+    for (int i = 0; i < PHASE_COUNT; i++)
     {
-        return -1.0f;
+        st->stalls += g.phaseStalls[i];
+        if (i != PHASE_WAIT && g.phaseStats[i].maxMs > st->slowestPhaseMs)
+        {
+            st->slowestPhaseMs = g.phaseStats[i].maxMs;
+            st->slowestPhase = i;
+        }
+    }
+    st->abandoned = g.abandonedStages;
+    st->tiered = g.scanTiered;
+    memcpy(st->sampled, g.scanSampled, sizeof(st->sampled));
+    st->deferred = g.scanDeferred;
+
+    // The loops below only feed the status dialog; while governed the last values stay.
+    st->detailsShed = g.governor.level > 0;
+    if (st->detailsShed)
+    {
+        const SCAN_STATUS *prev = &g.status[g.statusIndex & 1];
+        st->trackedCount = prev->trackedCount;
+        st->topCpuPid = prev->topCpuPid;
+        st->topCpu = prev->topCpu;
+        wcscpy_s(st->topCpuName, MAX_PATH_LEN, prev->topCpuName);
+        st->topMemPid = prev->topMemPid;
+        st->topMemMB = prev->topMemMB;
+        wcscpy_s(st->topMemName, MAX_PATH_LEN, prev->topMemName);
+    }
+    else
+    {
+        st->trackedCount = 0;
+        for (int i = 0; i < HISTORY_SHARD_COUNT; i++)
+        {
+            for (PROCESS_HISTORY *h = g.historyShards[i].head; h != NULL; h = h->next)
+                st->trackedCount++;
+        }
+        st->topCpuPid = st->topMemPid = 0;
+        st->topCpu = 0.0f;
+        st->topMemMB = 0;
+        st->topCpuName[0] = st->topMemName[0] = L'\0';
+        for (DWORD i = 0; i < g.scanCount; i++)
+        {
+            const SCAN_ENTRY *e = &g.scan[i];
+            if (!e->sample.valid)
+                continue;
+            if (e->sample.cpu > st->topCpu)
+            {
+                st->topCpu = e->sample.cpu;
+                st->topCpuPid = e->pe.th32ProcessID;
+                wcsncpy_s(st->topCpuName, MAX_PATH_LEN, e->pe.szExeFile, _TRUNCATE);
+            }
+            if (e->sample.memValid && e->sample.memMB > st->topMemMB)
+            {
+                st->topMemMB = e->sample.memMB;
+                st->topMemPid = e->pe.th32ProcessID;
+                wcsncpy_s(st->topMemName, MAX_PATH_LEN, e->pe.szExeFile, _TRUNCATE);
+            }
+        }
     }
 
-    LARGE_INTEGER nowPerf;
-    QueryPerformanceCounter(&nowPerf);
+    InterlockedIncrement(&st->seq);
+    InterlockedExchange(&g.statusIndex, (g.statusIndex + 1) & 1);
+}
 
-    ULARGE_INTEGER k1, u1, k2, u2;
-    k1.LowPart = hist->ftKernel.dwLowDateTime;
-    k1.HighPart = hist->ftKernel.dwHighDateTime;
-    u1.LowPart = hist->ftUser.dwLowDateTime;
-    u1.HighPart = hist->ftUser.dwHighDateTime;
-
-    k2.LowPart = ftKernel.dwLowDateTime;
-    k2.HighPart = ftKernel.dwHighDateTime;
-    u2.LowPart = ftUser.dwLowDateTime;
-    u2.HighPart = ftUser.dwHighDateTime;
-
-    ULONGLONG timeDelta = (k2.QuadPart - k1.QuadPart) + (u2.QuadPart - u1.QuadPart);
-    if (timeDelta == 0)
-        return 0.0f;
+// Copies the latest published status without blocking the monitor thread. Returns FALSE
+// if no consistent copy could be taken (the caller just shows less).
+static BOOL ReadScanStatus(SCAN_STATUS *out)
+{
+    for (int attempt = 0; attempt < STATUS_READ_RETRIES; attempt++)
+    {
+        const SCAN_STATUS *st = &g.status[InterlockedCompareExchange(&g.statusIndex, 0, 0) & 1];
+        LONG before = InterlockedCompareExchange((volatile LONG *)&st->seq, 0, 0);
+        if (before & 1)
+            continue;
+        memcpy(out, (const void *)st, sizeof(SCAN_STATUS));
+        MemoryBarrier();
+        if (InterlockedCompareExchange((volatile LONG *)&st->seq, 0, 0) == before)
+            return TRUE;
+    }
+    return FALSE;
+}
 
-    LARGE_INTEGER perfFreq;
-    QueryPerformanceFrequency(&perfFreq);
-    double seconds = (double)(nowPerf.QuadPart - hist->perfTime.QuadPart) / (double)perfFreq.QuadPart;
-    if (seconds <= 0.0)
-        return 0.0f;
+// -------------------- CPU Usage Calculation (using QPC) --------------------
+// Reads the process's total CPU time and moves the history baseline to it, returning the
+// previous baseline for the delta. Called by the worker that owns hist for this scan.
+static BOOL ReadCpuCounters(HANDLE hProcess, PROCESS_HISTORY *hist, ULONGLONG *cpuTime, ULONGLONG *prevCpuTime,
+                            LONGLONG *stamp, LONGLONG *prevStamp)
+{
+    FILETIME ftCreate, ftExit, ftKernel, ftUser;
+    if (!GetProcessTimes(hProcess, &ftCreate, &ftExit, &ftKernel, &ftUser))
+        return FALSE;
+    LARGE_INTEGER nowPerf;
+    QueryPerformanceCounter(&nowPerf);
 
-    double cpuPercent = (timeDelta / 10000.0) / seconds / 10.0;
+    *prevCpuTime = FileTimeToUll(&hist->ftKernel) + FileTimeToUll(&hist->ftUser);
+    *prevStamp = hist->perfTime.QuadPart;
+    *cpuTime = FileTimeToUll(&ftKernel) + FileTimeToUll(&ftUser);
+    *stamp = nowPerf.QuadPart;
 
     hist->ftKernel = ftKernel;
     hist->ftUser = ftUser;
     hist->perfTime = nowPerf;
+    return TRUE;
+}
 
-    return (float)cpuPercent;
+// Percent of one core for cpuTime (100 ns units) used over `elapsed` performance counter
+// ticks. ComputeScanUsage does the same for a whole scan at once.
+static float CpuPercent(ULONGLONG cpuTime, LONGLONG elapsed)
+{
+    if (elapsed <= 0)
+        return 0.0f;
+    return (float)((double)cpuTime * ((double)g.perfFrequency * 1e-5) / (double)elapsed);
 }
 
 float CalcAverageCpuUsage(HANDLE hProcess)
@@ -1071,7 +2391,7 @@ BOOL CALLBACK EnumHungWindowsProc(HWND hWnd, LPARAM lParam)
         LogMessage(L"WARNING: Reached maximum number of windows to check (MaxHungWindows=%lu). Some windows may not be checked. Consider increasing this value in config.ini if you have many windows.", params->maxWindows);
         return FALSE;
     }
-    if (WaitForSingleObject(params->stopEvent, 0) == WAIT_OBJECT_0)
+    if (WaitForSingleObject(params->stopEvent, 0) == WAIT_OBJECT_0 || StageAbandoned())
     {
         return FALSE;
     }
@@ -1093,10 +2413,19 @@ BOOL CALLBACK EnumHungWindowsProc(HWND hWnd, LPARAM lParam)
                 return TRUE;
             curr = curr->next;
         }
-        HUNG_PROCESS_NODE *node = (HUNG_PROCESS_NODE *)malloc(sizeof(HUNG_PROCESS_NODE));
+        // Lives until the end of the scan (ArenaReset in ProcessSnapshot).
+        HUNG_PROCESS_NODE *node = (HUNG_PROCESS_NODE *)ArenaAlloc(&g.scanArena, sizeof(HUNG_PROCESS_NODE));
         if (node)
         {
+            memset(node, 0, sizeof(HUNG_PROCESS_NODE));
             node->pid = pid;
+            HANDLE hProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+            if (hProcess)
+            {
+                FILETIME ftExit, ftKernel, ftUser;
+                GetProcessTimes(hProcess, &node->ftCreate, &ftExit, &ftKernel, &ftUser);
+                CloseHandle(hProcess);
+            }
             node->next = *(params->head);
             *(params->head) = node;
         }
@@ -1122,21 +2451,11 @@ HUNG_PROCESS_NODE *BuildHungProcessList(DWORD hangTimeoutMs, DWORD maxHungWindow
     return head;
 }
 
-void FreeHungProcessList(HUNG_PROCESS_NODE *head)
-{
-    while (head)
-    {
-        HUNG_PROCESS_NODE *tmp = head;
-        head = head->next;
-        free(tmp);
-    }
-}
-
-BOOL IsProcessHung(DWORD pid, HUNG_PROCESS_NODE *hungList)
+BOOL IsProcessHung(DWORD pid, const FILETIME *createTime, HUNG_PROCESS_NODE *hungList)
 {
     while (hungList)
     {
-        if (hungList->pid == pid)
+        if (hungList->pid == pid && SameCreateTime(&hungList->ftCreate, createTime))
             return TRUE;
         hungList = hungList->next;
     }
@@ -1180,14 +2499,20 @@ static void CloseLogFile(void)
     }
 }
 
-static void WriteLogUTF8(const char *utf8Buffer)
+// Converts text to UTF-8 and appends it to the log. The conversion buffer is too big
+// for the stack of the scan workers, so it is static and only used under csLog.
+static void WriteLogUTF8(const WCHAR *text)
 {
-    if (utf8Buffer == NULL)
+    // At most three UTF-8 bytes per UTF-16 unit (surrogate pairs take four for two).
+    static char utf8Buffer[4160 * 3];
+
+    if (text == NULL)
         return;
 
-    EnterCriticalSection(&g.csLog);
+    EnterSharedLock(&g.csLog);
     EnsureLogFileOpen();
-    if (g.hLogFile == INVALID_HANDLE_VALUE)
+    if (g.hLogFile == INVALID_HANDLE_VALUE ||
+        WideCharToMultiByte(CP_UTF8, 0, text, -1, utf8Buffer, (int)sizeof(utf8Buffer), NULL, NULL) <= 0)
     {
         LeaveCriticalSection(&g.csLog);
         return;
@@ -1239,18 +2564,7 @@ void LogMessageW(const WCHAR *format, ...)
     wcscpy_s(finalWide, 4160, timeBuf);
     wcscat_s(finalWide, 4160, wideBuf);
     wcscat_s(finalWide, 4160, L"\n");
-
-    int utf8Len = WideCharToMultiByte(CP_UTF8, 0, finalWide, -1, NULL, 0, NULL, NULL);
-    if (utf8Len > 0)
-    {
-        char *utf8Buf = (char *)malloc(utf8Len);
-        if (utf8Buf)
-        {
-            WideCharToMultiByte(CP_UTF8, 0, finalWide, -1, utf8Buf, utf8Len, NULL, NULL);
-            WriteLogUTF8(utf8Buf);
-            free(utf8Buf);
-        }
-    }
+    WriteLogUTF8(finalWide);
 }
 
 void LogErrorW(const WCHAR *format, ...)
@@ -1288,15 +2602,7 @@ void LogEvent(BOOL isSuspicious, const WCHAR *exeName, DWORD pid, const WCHAR *r
     WCHAR cpuStr[32];
     swprintf(cpuStr, 32, L"%.1f%%", cpu);
 
-    WCHAR pathBuf[INTERNAL_PATH_BUFFER_SIZE];
-    if (path && path[0] != L'\0')
-    {
-        wcscpy_s(pathBuf, INTERNAL_PATH_BUFFER_SIZE, path);
-    }
-    else
-    {
-        wcscpy_s(pathBuf, INTERNAL_PATH_BUFFER_SIZE, L"Path unavailable");
-    }
+    const WCHAR *pathBuf = (path && path[0] != L'\0') ? path : L"Path unavailable";
 
     if (isSuspicious)
     {
@@ -1308,7 +2614,7 @@ void LogEvent(BOOL isSuspicious, const WCHAR *exeName, DWORD pid, const WCHAR *r
         LogMessage(L"Terminated process: %ls (PID %u)\n  Reason: %ls\n  CPU: %ls  Memory: %ls\n  Path: %ls",
                    exeName, pid, reason, cpuStr, memStr, pathBuf);
         CONFIG cfg;
-        EnterCriticalSection(&g.csConfig);
+        EnterSharedLock(&g.csConfig);
         cfg = g.config;
         LeaveCriticalSection(&g.csConfig);
         if (cfg.notifyOnTermination)
@@ -1320,6 +2626,24 @@ void LogEvent(BOOL isSuspicious, const WCHAR *exeName, DWORD pid, const WCHAR *r
     }
 }
 
+static void LogActionEvent(const WCHAR *exeName, DWORD pid, const WCHAR *reason, const WCHAR *actionDesc,
+                           float cpu, size_t memMB, BOOL memValid, const WCHAR *path)
+{
+    WCHAR memStr[32];
+    if (memValid)
+    {
+        swprintf(memStr, 32, L"%llu MB", (unsigned long long)memMB);
+    }
+    else
+    {
+        wcscpy_s(memStr, 32, L"N/A");
+    }
+
+    LogMessage(L"Throttled process: %ls (PID %u)\n  Reason: %ls\n  Action: %ls\n  CPU: %.1f%%  Memory: %ls\n  Path: %ls",
+               exeName, pid, reason, actionDesc, cpu, memStr,
+               (path && path[0] != L'\0') ? path : L"Path unavailable");
+}
+
 static void SafeLogMessageAfterUnlock(const WCHAR *format, ...)
 {
     va_list args;
@@ -1332,7 +2656,7 @@ static void SafeLogMessageAfterUnlock(const WCHAR *format, ...)
 
 void RotateLogIfNeeded(DWORD maxSizeBytes)
 {
-    EnterCriticalSection(&g.csLog);
+    EnterSharedLock(&g.csLog);
     if (g.hLogFile == INVALID_HANDLE_VALUE)
     {
         LeaveCriticalSection(&g.csLog);
@@ -1416,262 +2740,1346 @@ void RotateLogIfNeeded(DWORD maxSizeBytes)
         SafeLogMessageAfterUnlock(L"Log rotated successfully.");
     }
 
-    EnterCriticalSection(&g.csLog);
+    EnterSharedLock(&g.csLog);
     EnsureLogFileOpen();
     LeaveCriticalSection(&g.csLog);
 }
 
 // -------------------- Helper Functions for Process Checking --------------------
-static BOOL OpenProcessForQuery(DWORD pid, HANDLE *phProcess, WCHAR *pathBuf, DWORD pathSize)
+// The private working set walk needs PROCESS_QUERY_INFORMATION, so with that metric the
+// cached handle is opened with it up front; without it the walk falls back to the working set.
+static HANDLE OpenQueryHandle(DWORD pid, int memMetric)
+{
+    HANDLE hProcess = NULL;
+    if (memMetric == MEM_METRIC_PRIVATE_WS)
+        hProcess = OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ, FALSE, pid);
+    if (hProcess == NULL)
+        hProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION | PROCESS_VM_READ, FALSE, pid);
+    if (hProcess == NULL)
+    {
+        hProcess = OpenProcess(PROCESS_QUERY_INFORMATION, FALSE, pid);
+    }
+    return hProcess;
+}
+
+// Resolves and interns a process's image path. hProcess may be NULL.
+static STRING_ID InternImagePath(HANDLE hProcess, DWORD pid)
 {
-    *phProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION | PROCESS_VM_READ, FALSE, pid);
-    if (*phProcess == NULL)
+    WCHAR path[PATH_SCRATCH_LEN];
+    DWORD size = PATH_SCRATCH_LEN;
+    if (hProcess && QueryFullProcessImageNameW(hProcess, 0, path, &size))
+        return InternString(path);
+
+    if (hProcess && GetLastError() == ERROR_INSUFFICIENT_BUFFER)
+    {
+        // Rare long path: borrow heap space instead of keeping a 64 KB stack buffer.
+        STRING_ID id = STRING_ID_NONE;
+        WCHAR *longPath = (WCHAR *)CountedAlloc(MAX_LONG_PATH * sizeof(WCHAR));
+        size = MAX_LONG_PATH;
+        if (longPath && QueryFullProcessImageNameW(hProcess, 0, longPath, &size))
+            id = InternString(longPath);
+        free(longPath);
+        return id;
+    }
+
+    GetProcessPathW(pid, path, PATH_SCRATCH_LEN);
+    return InternString(path);
+}
+
+// Private working set: walks the working set and counts pages that are not shared.
+// Expensive (one entry per resident page), so only used as a second-tier measurement.
+// The buffer is the calling worker's own, so no lock is held across QueryWorkingSet.
+// hProcess is the cached query handle; it fails here if it lacks PROCESS_QUERY_INFORMATION.
+static BOOL QueryPrivateWorkingSetMb(HANDLE hProcess, SCAN_WORKER *worker, size_t *memMB)
+{
+    BOOL ok = FALSE;
+    for (int attempt = 0; attempt < 3; attempt++)
     {
-        *phProcess = OpenProcess(PROCESS_QUERY_INFORMATION, FALSE, pid);
+        if (worker->wsInfo && QueryWorkingSet(hProcess, worker->wsInfo, worker->wsInfoSize))
+        {
+            ULONG_PTR privatePages = 0;
+            for (ULONG_PTR i = 0; i < worker->wsInfo->NumberOfEntries; i++)
+            {
+                if (!worker->wsInfo->WorkingSetInfo[i].Shared)
+                    privatePages++;
+            }
+            *memMB = (size_t)(((ULONGLONG)privatePages * g.pageSize) / (1024 * 1024));
+            ok = TRUE;
+            break;
+        }
+        if (worker->wsInfo && GetLastError() != ERROR_BAD_LENGTH)
+            break;
+
+        // Buffer too small (or not allocated yet): grow with some slack, since the
+        // working set can change between calls.
+        ULONG_PTR entries = worker->wsInfo ? worker->wsInfo->NumberOfEntries : 0;
+        if (entries < 4096)
+            entries = 4096;
+        entries += entries / 4;
+        DWORD newSize = (DWORD)(sizeof(PSAPI_WORKING_SET_INFORMATION) + entries * sizeof(PSAPI_WORKING_SET_BLOCK));
+        InterlockedIncrement(&g.scanHeapAllocs);
+        PSAPI_WORKING_SET_INFORMATION *newInfo = (PSAPI_WORKING_SET_INFORMATION *)realloc(worker->wsInfo, newSize);
+        if (!newInfo)
+            break;
+        worker->wsInfo = newInfo;
+        worker->wsInfoSize = newSize;
+        worker->wsInfo->NumberOfEntries = 0;
     }
-    if (*phProcess == NULL)
+    return ok;
+}
+
+// Measures the configured memory metric. Working set and private bytes come from one
+// GetProcessMemoryInfo call; the private working set is only walked for processes whose
+// working set (an upper bound for it) already exceeds the threshold.
+static BOOL MeasureProcessMemory(HANDLE hProcess, const CONFIG *cfg, SCAN_WORKER *worker, size_t *memMB)
+{
+    PROCESS_MEMORY_COUNTERS_EX pmc;
+    if (!GetProcessMemoryInfo(hProcess, (PROCESS_MEMORY_COUNTERS *)&pmc, sizeof(pmc)))
     {
-        GetProcessPathW(pid, pathBuf, pathSize);
+        *memMB = 0;
         return FALSE;
     }
-    DWORD size = pathSize;
-    BOOL success = QueryFullProcessImageNameW(*phProcess, 0, pathBuf, &size);
-    if (!success)
+
+    size_t workingSetMb = pmc.WorkingSetSize / (1024 * 1024);
+    switch (cfg->memMetric)
     {
-        GetProcessPathW(pid, pathBuf, pathSize);
+    case MEM_METRIC_PRIVATE:
+        *memMB = pmc.PrivateUsage / (1024 * 1024);
+        break;
+    case MEM_METRIC_PRIVATE_WS:
+        *memMB = workingSetMb;
+        if (workingSetMb > cfg->memThresholdMb)
+        {
+            size_t privateWsMb;
+            if (QueryPrivateWorkingSetMb(hProcess, worker, &privateWsMb))
+                *memMB = privateWsMb;
+        }
+        break;
+    default:
+        *memMB = workingSetMb;
+        break;
     }
     return TRUE;
 }
 
-static BOOL MeasureProcessResources(HANDLE hProcess, PROCESS_HISTORY *hist, float *cpu, size_t *memMB, BOOL *memValid)
+// -------------------- Memory Leak Trend --------------------
+static void LeakTrendAddSample(LEAK_TREND *trend, size_t memMB)
 {
-    *cpu = CalcCpuUsage(hProcess, hist);
-    if (*cpu < 0)
+    ULONGLONG now = GetTickCount64();
+    if (trend->count == 0)
+        trend->baseTick = now;
+
+    float t = (float)((now - trend->baseTick) / 1000.0);
+    float m = (float)memMB;
+
+    if (trend->count == LEAK_WINDOW)
+    {
+        float ot = trend->t[trend->next];
+        float om = trend->m[trend->next];
+        trend->sumT -= ot;
+        trend->sumM -= om;
+        trend->sumTT -= (double)ot * ot;
+        trend->sumTM -= (double)ot * om;
+        trend->sumMM -= (double)om * om;
+    }
+    else
+    {
+        trend->count++;
+    }
+    trend->t[trend->next] = t;
+    trend->m[trend->next] = m;
+    trend->sumT += t;
+    trend->sumM += m;
+    trend->sumTT += (double)t * t;
+    trend->sumTM += (double)t * m;
+    trend->sumMM += (double)m * m;
+    trend->next = (trend->next + 1) % LEAK_WINDOW;
+
+    // Recompute the sums once per window to stop rounding error from accumulating.
+    if (trend->next == 0 && trend->count == LEAK_WINDOW)
     {
-        *cpu = 0;
+        trend->sumT = trend->sumM = trend->sumTT = trend->sumTM = trend->sumMM = 0.0;
+        for (int i = 0; i < LEAK_WINDOW; i++)
+        {
+            trend->sumT += trend->t[i];
+            trend->sumM += trend->m[i];
+            trend->sumTT += (double)trend->t[i] * trend->t[i];
+            trend->sumTM += (double)trend->t[i] * trend->m[i];
+            trend->sumMM += (double)trend->m[i] * trend->m[i];
+        }
     }
+}
 
-    PROCESS_MEMORY_COUNTERS pmc;
-    if (GetProcessMemoryInfo(hProcess, &pmc, sizeof(pmc)))
+// Returns TRUE if the fitted growth is steady and fast enough to cross MemThresholdMb
+// within LeakHorizonSec.
+static BOOL LeakTrendPredict(const LEAK_TREND *trend, const CONFIG *cfg, size_t memMB, double *mbPerMin, double *secondsToLimit)
+{
+    if (trend->count < (int)cfg->leakMinSamples)
+        return FALSE;
+
+    double n = trend->count;
+    double varT = n * trend->sumTT - trend->sumT * trend->sumT;
+    double varM = n * trend->sumMM - trend->sumM * trend->sumM;
+    double cov = n * trend->sumTM - trend->sumT * trend->sumM;
+    if (varT <= 0.0 || varM <= 0.0 || cov <= 0.0)
+        return FALSE;
+
+    double slope = cov / varT; // MB per second
+    double rSquared = (cov * cov) / (varT * varM);
+    *mbPerMin = slope * 60.0;
+    if (*mbPerMin < cfg->leakMinGrowthMbPerMin || rSquared < LEAK_MIN_R_SQUARED)
+        return FALSE;
+    if (memMB >= cfg->memThresholdMb)
+        return FALSE; // already handled by the memory rule
+
+    *secondsToLimit = (cfg->memThresholdMb - (double)memMB) / slope;
+    return *secondsToLimit <= cfg->leakHorizonSec;
+}
+
+// Fitted growth in MB/minute regardless of fit quality (0 if too few samples or shrinking).
+static double LeakTrendGrowthMbPerMin(const LEAK_TREND *trend)
+{
+    if (trend->count < MIN_LEAK_MIN_SAMPLES)
+        return 0.0;
+    double n = trend->count;
+    double varT = n * trend->sumTT - trend->sumT * trend->sumT;
+    double cov = n * trend->sumTM - trend->sumT * trend->sumM;
+    if (varT <= 0.0 || cov <= 0.0)
+        return 0.0;
+    return cov / varT * 60.0;
+}
+
+// -------------------- CPU Normalization --------------------
+static DWORD GetMachineProcessorCount(void)
+{
+    // GetActiveProcessorCount (Windows 7+) also counts processors outside the current group.
+    typedef DWORD(WINAPI * PFN_GET_ACTIVE_PROCESSOR_COUNT)(WORD);
+    PFN_GET_ACTIVE_PROCESSOR_COUNT pfn = (PFN_GET_ACTIVE_PROCESSOR_COUNT)(void *)GetProcAddress(
+        GetModuleHandleW(L"kernel32.dll"), "GetActiveProcessorCount");
+    DWORD count = pfn ? pfn(0xFFFF /* ALL_PROCESSOR_GROUPS */) : 0;
+    return count > 0 ? count : g.numProcessors;
+}
+
+// Number of logical processors the process may run on (its affinity mask within its group).
+static DWORD GetAllowedProcessorCount(HANDLE hProcess)
+{
+    DWORD_PTR processMask = 0, systemMask = 0;
+    if (!hProcess || !GetProcessAffinityMask(hProcess, &processMask, &systemMask) || processMask == 0)
+        return g.numProcessors;
+    if (processMask == systemMask && g.machineProcessors > g.numProcessors)
+        return g.machineProcessors; // unrestricted; the scheduler may spread it across groups
+    DWORD count = 0;
+    while (processMask)
     {
-        *memMB = pmc.WorkingSetSize / (1024 * 1024);
-        *memValid = TRUE;
+        processMask &= processMask - 1;
+        count++;
     }
-    else
+    return count;
+}
+
+// Converts percent-of-one-core to the unit selected by CpuNormalization.
+// Factor from percent of one core to the configured CpuNormalization.
+static float CpuNormScale(DWORD allowedCores, const CONFIG *cfg)
+{
+    switch (cfg->cpuNormalization)
     {
-        *memMB = 0;
-        *memValid = FALSE;
+    case CPU_NORM_MACHINE:
+        return 1.0f / (float)g.machineProcessors;
+    case CPU_NORM_ALLOWED:
+        return 1.0f / (float)(allowedCores ? allowedCores : 1);
+    default:
+        return 1.0f;
     }
-    return TRUE;
 }
 
-static void FormatReason(WCHAR *buffer, size_t bufSize, float cpu, DWORD cpuThreshold,
-                         BOOL memValid, size_t memMB, DWORD memThreshold, BOOL hung)
+static float NormalizeCpu(float rawCpu, DWORD allowedCores, const CONFIG *cfg)
+{
+    return rawCpu * CpuNormScale(allowedCores, cfg);
+}
+
+// Returns the first RULE_* that was violated (RULE_NONE if none) and fills the reason text.
+// Rules whose bit (1 << RULE_*) is set in skipRules are passed over.
+static int FormatReason(WCHAR *buffer, size_t bufSize, float cpu, DWORD cpuThreshold, int cpuNorm,
+                        BOOL memValid, size_t memMB, DWORD memThreshold, int memMetric, BOOL hung, DWORD skipRules)
 {
     buffer[0] = L'\0';
-    if (cpu > cpuThreshold)
+    if (!(skipRules & (1u << RULE_CPU)) && cpu > cpuThreshold)
     {
-        swprintf(buffer, bufSize, L"High CPU: %.1f%% (threshold %lu%%)", cpu, cpuThreshold);
+        swprintf(buffer, bufSize, L"High CPU: %.1f%%%ls (threshold %lu%%)", cpu, CPU_NORM_LABELS[cpuNorm], cpuThreshold);
+        return RULE_CPU;
     }
-    else if (memValid && memMB > memThreshold)
+    else if (!(skipRules & (1u << RULE_MEM)) && memValid && memMB > memThreshold)
     {
-        swprintf(buffer, bufSize, L"High memory: %llu MB (threshold %lu MB)", (unsigned long long)memMB, memThreshold);
+        if (memMetric == MEM_METRIC_WORKING_SET)
+            swprintf(buffer, bufSize, L"High memory: %llu MB (threshold %lu MB)", (unsigned long long)memMB, memThreshold);
+        else
+            swprintf(buffer, bufSize, L"High memory (%ls): %llu MB (threshold %lu MB)",
+                     MEM_METRIC_LABELS[memMetric], (unsigned long long)memMB, memThreshold);
+        return RULE_MEM;
     }
-    else if (hung)
+    else if (!(skipRules & (1u << RULE_HANG)) && hung)
     {
         swprintf(buffer, bufSize, L"Window not responding");
+        return RULE_HANG;
     }
+    return RULE_NONE;
 }
 
-static BOOL TryTerminateProcess(DWORD pid, const WCHAR *exeName, int *attempts, int *logSent)
+// -------------------- Termination Circuit Breaker --------------------
+// Called only for violations about to lead to a new action; processes whose attempts are
+// exhausted, whose throttle is already in place or whose termination is pending do not
+// feed the storm detector.
+static void NoteViolation(void)
 {
-    HANDLE hProcess = OpenProcess(PROCESS_TERMINATE, FALSE, pid);
-    if (hProcess == NULL)
+    g.breaker.violationsThisScan++;
+}
+
+static void RefillBucket(double *tokens, DWORD ratePerMinute, double minutes)
+{
+    *tokens += minutes * ratePerMinute;
+    if (*tokens > ratePerMinute)
+        *tokens = ratePerMinute;
+}
+
+// Consumes a termination token for the rule. Returns FALSE (and counts the suppression)
+// during a violation storm or when the global or per-rule rate is exhausted.
+static BOOL AllowTermination(int rule, const CONFIG *cfg)
+{
+    KILL_BREAKER *b = &g.breaker;
+    if (cfg->stormThreshold && (b->storm || b->violationsThisScan > cfg->stormThreshold))
     {
-        DWORD err = GetLastError();
-        const WCHAR *desc = GetErrorDescription(err);
-        LogMessage(L"Failed to open process %ls (PID %u) for termination: %ls (Error %lu)", exeName, pid, desc, err);
-        static BOOL accessDeniedShown = FALSE;
-        if (err == ERROR_ACCESS_DENIED && !accessDeniedShown)
-        {
-            accessDeniedShown = TRUE;
-            ShowBalloon(L"Permission Notice", L"Some processes could not be terminated due to insufficient privileges. For full functionality, please run the program as administrator.", NIIF_WARNING);
-        }
+        b->suppressedStormScan++;
+        b->suppressedTotal++;
         return FALSE;
     }
-    if (TerminateProcess(hProcess, 1))
+
+    ULONGLONG now = GetTickCount64();
+    if (b->lastRefillTick == 0)
     {
-        LogMessage(L"Successfully terminated process %ls (PID %u)", exeName, pid);
-        CloseHandle(hProcess);
-        return TRUE;
+        b->tokens = cfg->killRatePerMinute;
+        for (int r = 0; r < RULE_COUNT; r++)
+            b->ruleTokens[r] = cfg->ruleKillRatePerMinute[r];
     }
     else
     {
-        DWORD err = GetLastError();
-        const WCHAR *desc = GetErrorDescription(err);
-        LogMessage(L"Failed to terminate process %ls (PID %u): %ls (Error %lu)", exeName, pid, desc, err);
-        CloseHandle(hProcess);
-        if (attempts)
-            (*attempts)++;
-        if (logSent && *logSent == 0 && attempts && *attempts >= TERMINATE_RETRY_LIMIT)
-        {
-            LogMessage(L"Process %ls (PID %u) termination attempts exhausted, will stop trying.", exeName, pid);
-            *logSent = 1;
-        }
+        double minutes = (now - b->lastRefillTick) / 60000.0;
+        RefillBucket(&b->tokens, cfg->killRatePerMinute, minutes);
+        for (int r = 0; r < RULE_COUNT; r++)
+            RefillBucket(&b->ruleTokens[r], cfg->ruleKillRatePerMinute[r], minutes);
+    }
+    b->lastRefillTick = now;
+
+    BOOL globalOk = cfg->killRatePerMinute == 0 || b->tokens >= 1.0;
+    BOOL ruleOk = cfg->ruleKillRatePerMinute[rule] == 0 || b->ruleTokens[rule] >= 1.0;
+    if (!globalOk || !ruleOk)
+    {
+        b->suppressedRateScan++;
+        b->suppressedTotal++;
         return FALSE;
     }
+    if (cfg->killRatePerMinute)
+        b->tokens -= 1.0;
+    if (cfg->ruleKillRatePerMinute[rule])
+        b->ruleTokens[rule] -= 1.0;
+    return TRUE;
 }
 
-static void CheckProcessHungAndTerminate(PROCESS_HISTORY *hist, DWORD pid, const WCHAR *exeName, HUNG_PROCESS_NODE *hungList)
+// Storm state is decided from the previous scan, and also trips mid-scan (see AllowTermination).
+static void BeginBreakerScan(const CONFIG *cfg)
 {
-    if (!IsProcessHung(pid, hungList))
+    KILL_BREAKER *b = &g.breaker;
+    b->violationsLastScan = b->violationsThisScan;
+    b->violationsThisScan = 0;
+    b->suppressedRateScan = 0;
+    b->suppressedStormScan = 0;
+
+    BOOL storm = cfg->stormThreshold && b->violationsLastScan > cfg->stormThreshold;
+    if (storm != b->storm)
     {
-        if (hist)
-            hist->terminateAttemptsHung = 0;
-        return;
+        if (storm)
+            LogMessage(L"Violation storm: %lu processes violated rules in one scan (threshold %lu), terminations suspended (log only)",
+                       b->violationsLastScan, cfg->stormThreshold);
+        else
+            LogMessage(L"Violation storm over, terminations resumed (%llu suppressed so far)", b->suppressedTotal);
+        b->storm = storm;
     }
+}
 
-    int attempts = hist ? hist->terminateAttemptsHung : 0;
-    int logSent = hist ? hist->terminateLogSentHung : 0;
+static void EndBreakerScan(void)
+{
+    KILL_BREAKER *b = &g.breaker;
+    if (b->suppressedRateScan || b->suppressedStormScan)
+    {
+        LogMessage(L"Circuit breaker suppressed %lu termination(s) this scan (%lu rate limit, %lu storm), %llu total",
+                   b->suppressedRateScan + b->suppressedStormScan, b->suppressedRateScan, b->suppressedStormScan,
+                   b->suppressedTotal);
+    }
+}
 
-    if (attempts >= TERMINATE_RETRY_LIMIT)
+// -------------------- Action Executor --------------------
+static BOOL FindTerminateRequest(const TERMINATE_REQUEST *list, DWORD pid, const FILETIME *createTime)
+{
+    for (const TERMINATE_REQUEST *r = list; r != NULL; r = r->next)
     {
-        if (!logSent && hist)
-        {
-            LogMessage(L"Process %ls (PID %u) is hung but termination attempts exhausted, skipping further attempts", exeName, pid);
-            hist->terminateLogSentHung = 1;
-        }
-        return;
+        if (r->pid == pid && SameCreateTime(&r->createTime, createTime))
+            return TRUE;
     }
+    return FALSE;
+}
 
-    if (TryTerminateProcess(pid, exeName, &attempts, &logSent))
+// Hands a termination to the executor thread. Returns FALSE if one is already queued,
+// in flight or waiting for a graceful close for the PID; without a history (unknown
+// creation time) any request for the PID counts. The history, if any, is marked pending
+// until the outcome is reported.
+static BOOL QueueTermination(PROCESS_HISTORY *hist, DWORD pid, const WCHAR *exeName, DWORD closeTimeoutMs)
+{
+    EnterCriticalSection(&g.csActions);
+    const FILETIME *createTime = hist ? &hist->ftCreate : NULL;
+    if (FindTerminateRequest(g.actionQueue, pid, createTime) || FindTerminateRequest(g.actionWaiting, pid, createTime) ||
+        (g.actionInFlight && g.actionInFlight->pid == pid && SameCreateTime(&g.actionInFlight->createTime, createTime)))
     {
-        RemoveHistory(pid);
+        LeaveCriticalSection(&g.csActions);
+        return FALSE;
     }
-    else
+    InterlockedIncrement(&g.scanHeapAllocs);
+    TERMINATE_REQUEST *req = (TERMINATE_REQUEST *)calloc(1, sizeof(TERMINATE_REQUEST));
+    if (!req)
     {
-        if (hist)
-        {
-            hist->terminateAttemptsHung = attempts;
-            hist->terminateLogSentHung = logSent;
-        }
+        LeaveCriticalSection(&g.csActions);
+        LogError(L"Out of memory queueing termination of %ls (PID %u)", exeName, pid);
+        return FALSE;
     }
+    req->pid = pid;
+    if (createTime)
+        req->createTime = *createTime;
+    req->closeTimeoutMs = closeTimeoutMs;
+    req->nameId = hist ? hist->nameId : InternString(exeName);
+    req->next = g.actionQueue;
+    g.actionQueue = req;
+    LeaveCriticalSection(&g.csActions);
+
+    if (hist)
+        hist->terminatePending = TRUE;
+    SetEvent(g.hActionEvent);
+    return TRUE;
 }
 
-static void CheckProcessResourcesAndTerminate(PROCESS_HISTORY *hist, HANDLE hProcess, DWORD pid, const WCHAR *exeName,
-                                              const WCHAR *path, const CONFIG *cfg, HUNG_PROCESS_NODE *hungList)
+// Applies executor outcomes to history. Called by the scan thread before each scan, so
+// history is never touched from the executor thread.
+static void ProcessActionResults(void)
 {
-    float cpu = 0.0f;
-    size_t memMB = 0;
-    BOOL memValid = FALSE;
-
-    MeasureProcessResources(hProcess, hist, &cpu, &memMB, &memValid);
-
-    BOOL abnormal = FALSE;
-    WCHAR reason[512];
-    BOOL hung = IsProcessHung(pid, hungList);
-    FormatReason(reason, 512, cpu, cfg->cpuThresholdPercent,
-                 memValid, memMB, cfg->memThresholdMb, hung);
+    EnterCriticalSection(&g.csActions);
+    TERMINATE_REQUEST *results = g.actionResults;
+    g.actionResults = NULL;
+    LeaveCriticalSection(&g.csActions);
 
-    if (reason[0] != L'\0')
+    while (results)
     {
-        abnormal = TRUE;
-    }
+        TERMINATE_REQUEST *r = results;
+        results = r->next;
 
-    if (abnormal)
-    {
-        if (hist->terminateAttempts >= TERMINATE_RETRY_LIMIT)
+        for (PROCESS_HISTORY *h = HistoryShard(r->pid)->head; h != NULL; h = h->next)
         {
-            if (!hist->terminateLogSent)
+            if (h->pid != r->pid || !SameCreateTime(&h->ftCreate, &r->createTime))
+                continue;
+            h->terminatePending = FALSE;
+            if (!r->exited)
             {
-                LogMessage(L"Process %ls (PID %u) exceeds threshold but termination attempts exhausted, skipping further attempts", exeName, pid);
-                hist->terminateLogSent = 1;
+                // The executor already retried with backoff and logged the failure.
+                h->terminateAttempts = h->terminateAttemptsHung = h->terminateAttemptsTree = TERMINATE_RETRY_LIMIT;
+                h->terminateLogSent = h->terminateLogSentHung = h->terminateLogSentTree = 1;
             }
-            return;
-        }
-
-        LogEvent(FALSE, exeName, pid, reason, cpu, memMB, memValid, path);
-        if (TryTerminateProcess(pid, exeName, &hist->terminateAttempts, &hist->terminateLogSent))
-        {
-            RemoveHistory(pid);
+            break;
         }
+        free(r);
     }
-    else
+}
+
+typedef struct _CLOSE_WINDOWS_PARAMS
+{
+    DWORD pid;
+    int posted;
+} CLOSE_WINDOWS_PARAMS;
+
+static BOOL CALLBACK PostCloseToWindowsProc(HWND hWnd, LPARAM lParam)
+{
+    CLOSE_WINDOWS_PARAMS *params = (CLOSE_WINDOWS_PARAMS *)lParam;
+    DWORD pid = 0;
+    GetWindowThreadProcessId(hWnd, &pid);
+    if (pid == params->pid && IsWindowVisible(hWnd) && GetWindow(hWnd, GW_OWNER) == NULL)
     {
-        hist->terminateAttempts = 0;
-        hist->terminateLogSent = 0;
+        if (PostMessageW(hWnd, WM_CLOSE, 0, 0))
+            params->posted++;
     }
+    return TRUE;
 }
 
-// -------------------- Process Check Functions --------------------
-static void CheckNormalProcess(const PROCESSENTRY32W *pe, const CONFIG *cfg, HUNG_PROCESS_NODE *hungList)
+// Runs on a thread-pool thread when the process exits or its close window expires.
+static VOID CALLBACK GracefulCloseCallback(PVOID context, BOOLEAN timedOut)
 {
-    WCHAR processPath[INTERNAL_PATH_BUFFER_SIZE] = L"";
-    HANDLE hProcess = NULL;
+    TERMINATE_REQUEST *req = (TERMINATE_REQUEST *)context;
 
-    PROCESS_HISTORY *hist = FindOrCreateHistory(pe->th32ProcessID);
-    if (!hist)
+    EnterCriticalSection(&g.csActions);
+    if (g.actionShutdown)
     {
-        CheckProcessHungAndTerminate(NULL, pe->th32ProcessID, pe->szExeFile, hungList);
+        LeaveCriticalSection(&g.csActions); // Cleanup owns the request now
         return;
     }
+    for (TERMINATE_REQUEST **pp = &g.actionWaiting; *pp != NULL; pp = &(*pp)->next)
+    {
+        if (*pp == req)
+        {
+            *pp = req->next;
+            break;
+        }
+    }
+    UnregisterWaitEx(req->hWait, NULL); // non-blocking; allowed from the callback itself
+    req->hWait = NULL;
+    CloseHandle(req->hProcess);
+    req->hProcess = NULL;
+    // Logged and signalled under the lock so Cleanup cannot tear down the log or the
+    // event between our shutdown check and their use.
+    if (timedOut)
+    {
+        LogMessage(L"Process %ls (PID %u) did not close within %lu ms, forcing termination", StringFromId(req->nameId), req->pid,
+                   req->closeTimeoutMs);
+        req->notBefore = 0;
+        req->next = g.actionQueue;
+        g.actionQueue = req;
+        SetEvent(g.hActionEvent);
+    }
+    else
+    {
+        LogMessage(L"Process %ls (PID %u) closed after a close request", StringFromId(req->nameId), req->pid);
+        req->exited = TRUE;
+        req->next = g.actionResults;
+        g.actionResults = req;
+    }
+    LeaveCriticalSection(&g.csActions);
+}
 
-    if (!OpenProcessForQuery(pe->th32ProcessID, &hProcess, processPath, INTERNAL_PATH_BUFFER_SIZE))
+// Posts WM_CLOSE to the process's top-level windows and registers a thread-pool wait on
+// its handle with the close timeout, so pending closes cost no polling. Returns TRUE if
+// the request (and hProcess) now belongs to the wait.
+static BOOL RequestGracefulClose(TERMINATE_REQUEST *req, HANDLE hProcess)
+{
+    CLOSE_WINDOWS_PARAMS params = {req->pid, 0};
+    EnumWindows(PostCloseToWindowsProc, (LPARAM)&params);
+    if (params.posted == 0)
+        return FALSE; // no window to close (console or background process)
+
+    req->hProcess = hProcess;
+    EnterCriticalSection(&g.csActions);
+    // Registered under the lock so the callback cannot run before hWait is stored.
+    if (!RegisterWaitForSingleObject(&req->hWait, hProcess, GracefulCloseCallback, req, req->closeTimeoutMs,
+                                     WT_EXECUTEONLYONCE))
     {
-        CheckProcessHungAndTerminate(hist, pe->th32ProcessID, pe->szExeFile, hungList);
-        return;
+        LeaveCriticalSection(&g.csActions);
+        req->hProcess = NULL;
+        return FALSE;
     }
+    req->next = g.actionWaiting;
+    g.actionWaiting = req;
+    LeaveCriticalSection(&g.csActions);
 
-    CheckProcessResourcesAndTerminate(hist, hProcess, pe->th32ProcessID, pe->szExeFile,
-                                      processPath, cfg, hungList);
-    CloseHandle(hProcess);
+    LogMessage(L"Requested close of process %ls (PID %u) via %d window(s), forcing in %lu ms if it does not exit",
+               StringFromId(req->nameId), req->pid, params.posted, req->closeTimeoutMs);
+    return TRUE;
 }
 
-static void CheckSystemProcess(const PROCESSENTRY32W *pe, const CONFIG *cfg, HUNG_PROCESS_NODE *hungList)
+// Issues one termination attempt and waits for the exit to be confirmed.
+// Returns TRUE when the process is gone; *permanent is set for failures not worth retrying
+// and *deferred when the request was handed to a graceful-close wait.
+static BOOL ExecuteTermination(TERMINATE_REQUEST *req, BOOL *permanent, BOOL *deferred)
 {
-    WCHAR processPath[INTERNAL_PATH_BUFFER_SIZE] = L"";
-    GetProcessPathW(pe->th32ProcessID, processPath, INTERNAL_PATH_BUFFER_SIZE);
-
-    if (IsProcessHung(pe->th32ProcessID, hungList))
+    *permanent = FALSE;
+    *deferred = FALSE;
+    // Verified open: if the PID now belongs to a different process, the one we meant is gone.
+    HANDLE hProcess = OpenVerifiedProcess(PROCESS_TERMINATE | SYNCHRONIZE, req->pid, &req->createTime);
+    if (hProcess == NULL)
     {
-        if (ShouldShowBalloonForProcess(pe->szExeFile))
+        DWORD err = GetLastError();
+        if (err == ERROR_INVALID_PARAMETER)
         {
-            WCHAR balloonText[512];
-            swprintf(balloonText, 512, L"System process %ls (PID %u) has a hung window.\nPath: %ls\n(This could be normal activity; check the path if concerned.)",
-                     pe->szExeFile, pe->th32ProcessID, processPath);
-            ShowBalloon(L"Suspicious System Process", balloonText, NIIF_WARNING);
+            LogMessage(L"Process %ls (PID %u) exited before it was terminated", StringFromId(req->nameId), req->pid);
+            return TRUE;
         }
-        LogEvent(TRUE, pe->szExeFile, pe->th32ProcessID, L"Window not responding",
-                 0.0f, 0, FALSE, processPath);
-        return;
+        const WCHAR *desc = GetErrorDescription(err);
+        LogMessage(L"Failed to open process %ls (PID %u) for termination: %ls (Error %lu)", StringFromId(req->nameId), req->pid, desc, err);
+        static BOOL accessDeniedShown = FALSE;
+        if (err == ERROR_ACCESS_DENIED)
+        {
+            *permanent = TRUE;
+            if (!accessDeniedShown)
+            {
+                accessDeniedShown = TRUE;
+                ShowBalloon(L"Permission Notice", L"Some processes could not be terminated due to insufficient privileges. For full functionality, please run the program as administrator.", NIIF_WARNING);
+            }
+        }
+        return FALSE;
     }
 
-    HANDLE hProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION | PROCESS_VM_READ, FALSE, pe->th32ProcessID);
-    if (!hProcess)
+    if (req->closeTimeoutMs > 0 && !req->closeRequested)
     {
-        return;
+        req->closeRequested = TRUE;
+        if (RequestGracefulClose(req, hProcess))
+        {
+            *deferred = TRUE;
+            return FALSE;
+        }
     }
 
-    PROCESS_HISTORY *hist = FindOrCreateHistory(pe->th32ProcessID);
-    float instCpu = 0.0f;
-    if (hist)
+    ULONGLONG start = GetTickCount64();
+    if (!TerminateProcess(hProcess, 1))
     {
-        instCpu = CalcCpuUsage(hProcess, hist);
-        if (instCpu < 0)
-            instCpu = 0.0f;
-    }
-
-    PROCESS_MEMORY_COUNTERS pmc;
-    size_t memMB = 0;
-    BOOL memValid = FALSE;
-    if (GetProcessMemoryInfo(hProcess, &pmc, sizeof(pmc)))
+        DWORD err = GetLastError();
+        // Access denied here usually means the process is already exiting.
+        if (WaitForSingleObject(hProcess, 0) != WAIT_OBJECT_0)
+        {
+            const WCHAR *desc = GetErrorDescription(err);
+            LogMessage(L"Failed to terminate process %ls (PID %u): %ls (Error %lu)", StringFromId(req->nameId), req->pid, desc, err);
+            CloseHandle(hProcess);
+            return FALSE;
+        }
+    }
+
+    HANDLE waits[2] = {hProcess, g.hStopEvent};
+    DWORD wr = WaitForMultipleObjects(2, waits, FALSE, TERMINATE_CONFIRM_TIMEOUT_MS);
+    if (wr == WAIT_OBJECT_0)
+    {
+        DWORD exitCode = 0;
+        GetExitCodeProcess(hProcess, &exitCode);
+        LogMessage(L"Successfully terminated process %ls (PID %u), exit confirmed after %llu ms (exit code %lu)",
+                   StringFromId(req->nameId), req->pid, (unsigned long long)(GetTickCount64() - start), exitCode);
+        CloseHandle(hProcess);
+        return TRUE;
+    }
+    if (wr != WAIT_OBJECT_0 + 1)
+    {
+        LogMessage(L"Process %ls (PID %u) did not exit within %u ms of termination", StringFromId(req->nameId), req->pid,
+                   TERMINATE_CONFIRM_TIMEOUT_MS);
+    }
+    CloseHandle(hProcess);
+    return FALSE;
+}
+
+// Executor thread: takes due requests off the queue, terminates, confirms the exit and
+// retries with exponential backoff, so the scan loop never blocks on actions.
+DWORD WINAPI ActionThread(LPVOID lpParam)
+{
+    (void)lpParam;
+    HANDLE waits[2] = {g.hStopEvent, g.hActionEvent};
+    for (;;)
+    {
+        ULONGLONG now = GetTickCount64();
+        TERMINATE_REQUEST *due = NULL;
+        ULONGLONG nextDue = MAXULONGLONG;
+
+        EnterCriticalSection(&g.csActions);
+        for (TERMINATE_REQUEST **pp = &g.actionQueue; *pp != NULL; pp = &(*pp)->next)
+        {
+            if ((*pp)->notBefore <= now)
+            {
+                due = *pp;
+                *pp = due->next;
+                due->next = NULL;
+                g.actionInFlight = due;
+                break;
+            }
+            if ((*pp)->notBefore < nextDue)
+                nextDue = (*pp)->notBefore;
+        }
+        LeaveCriticalSection(&g.csActions);
+
+        if (!due)
+        {
+            DWORD timeout = nextDue == MAXULONGLONG ? INFINITE : (DWORD)(nextDue - now);
+            if (WaitForMultipleObjects(2, waits, FALSE, timeout) == WAIT_OBJECT_0)
+                break;
+            continue;
+        }
+
+        BOOL permanent = FALSE, deferred = FALSE;
+        BOOL exited = ExecuteTermination(due, &permanent, &deferred);
+        if (deferred)
+        {
+            // Now on g.actionWaiting (or already back on the queue from its callback).
+            EnterCriticalSection(&g.csActions);
+            g.actionInFlight = NULL;
+            LeaveCriticalSection(&g.csActions);
+            continue;
+        }
+        if (WaitForSingleObject(g.hStopEvent, 0) == WAIT_OBJECT_0)
+        {
+            EnterCriticalSection(&g.csActions);
+            g.actionInFlight = NULL;
+            LeaveCriticalSection(&g.csActions);
+            free(due);
+            break;
+        }
+        due->attempts++;
+        if (!exited && !permanent && due->attempts < TERMINATE_RETRY_LIMIT)
+        {
+            due->notBefore = GetTickCount64() + ((ULONGLONG)TERMINATE_RETRY_BASE_MS << (due->attempts - 1));
+            EnterCriticalSection(&g.csActions);
+            g.actionInFlight = NULL;
+            due->next = g.actionQueue;
+            g.actionQueue = due;
+            LeaveCriticalSection(&g.csActions);
+            continue;
+        }
+        if (!exited)
+        {
+            LogMessage(L"Process %ls (PID %u) termination attempts exhausted after %d attempt(s), will stop trying.",
+                       StringFromId(due->nameId), due->pid, due->attempts);
+        }
+        due->exited = exited;
+        EnterCriticalSection(&g.csActions);
+        g.actionInFlight = NULL;
+        due->next = g.actionResults;
+        g.actionResults = due;
+        LeaveCriticalSection(&g.csActions);
+    }
+    return 0;
+}
+
+static void FreeTerminateRequests(TERMINATE_REQUEST *list)
+{
+    while (list)
+    {
+        TERMINATE_REQUEST *next = list->next;
+        free(list);
+        list = next;
+    }
+}
+
+static HANDLE GetOrCreateProcessJob(PROCESS_HISTORY *hist, DWORD pid, const WCHAR *exeName)
+{
+    if (hist->hJob)
+        return hist->hJob;
+
+    HANDLE hProcess = OpenVerifiedProcess(PROCESS_SET_QUOTA | PROCESS_TERMINATE, pid, &hist->ftCreate);
+    if (hProcess == NULL)
+    {
+        DWORD err = GetLastError();
+        LogMessage(L"Failed to open process %ls (PID %u) for job assignment: %ls (Error %lu)", exeName, pid, GetErrorDescription(err), err);
+        return NULL;
+    }
+
+    HANDLE hJob = CreateJobObjectW(NULL, NULL);
+    if (hJob == NULL)
+    {
+        LogError(L"CreateJobObject failed for process %ls (PID %u)", exeName, pid);
+        CloseHandle(hProcess);
+        return NULL;
+    }
+
+    // Before Windows 8 a process can belong to only one job, so this fails
+    // with access denied for processes already placed in a job by their parent.
+    if (!AssignProcessToJobObject(hJob, hProcess))
+    {
+        DWORD err = GetLastError();
+        LogMessage(L"Failed to assign process %ls (PID %u) to a job object: %ls (Error %lu)", exeName, pid, GetErrorDescription(err), err);
+        CloseHandle(hJob);
+        CloseHandle(hProcess);
+        return NULL;
+    }
+    CloseHandle(hProcess);
+
+    hist->hJob = hJob;
+    return hJob;
+}
+
+// Applies a non-terminating action to a process. Each action is applied only once per
+// process; returns TRUE if the action is (now or already) in effect.
+static BOOL TryThrottleProcess(PROCESS_HISTORY *hist, DWORD pid, const WCHAR *exeName, int action,
+                               const CONFIG *cfg, WCHAR *actionDesc, size_t descSize)
+{
+    actionDesc[0] = L'\0';
+    if (hist->throttleApplied & (1u << action))
+        return TRUE;
+
+    BOOL ok = FALSE;
+    DWORD err = 0;
+    switch (action)
+    {
+    case ACTION_LOWER_PRIORITY:
+    {
+        HANDLE hProcess = OpenVerifiedProcess(PROCESS_SET_INFORMATION, pid, &hist->ftCreate);
+        if (hProcess)
+        {
+            DWORD priorityClass = cfg->throttleIdlePriority ? IDLE_PRIORITY_CLASS : BELOW_NORMAL_PRIORITY_CLASS;
+            ok = SetPriorityClass(hProcess, priorityClass);
+            if (!ok)
+                err = GetLastError();
+            CloseHandle(hProcess);
+        }
+        else
+        {
+            err = GetLastError();
+        }
+        swprintf(actionDesc, descSize, L"Priority lowered to %ls",
+                 cfg->throttleIdlePriority ? L"idle" : L"below normal");
+        break;
+    }
+    case ACTION_RESTRICT_AFFINITY:
+    {
+        HANDLE hProcess = OpenVerifiedProcess(PROCESS_SET_INFORMATION, pid, &hist->ftCreate);
+        if (hProcess)
+        {
+            DWORD_PTR processMask = 0, systemMask = 0;
+            if (GetProcessAffinityMask(hProcess, &processMask, &systemMask) && processMask != 0)
+            {
+                // Keep the highest-numbered allowed cores; core 0 usually carries
+                // most interrupt and interactive load.
+                DWORD_PTR newMask = 0;
+                DWORD kept = 0;
+                for (int bit = (int)(sizeof(DWORD_PTR) * 8) - 1; bit >= 0 && kept < cfg->throttleAffinityCores; bit--)
+                {
+                    DWORD_PTR b = (DWORD_PTR)1 << bit;
+                    if (processMask & b)
+                    {
+                        newMask |= b;
+                        kept++;
+                    }
+                }
+                ok = SetProcessAffinityMask(hProcess, newMask);
+                if (!ok)
+                    err = GetLastError();
+                swprintf(actionDesc, descSize, L"Affinity restricted to %lu core(s) (mask 0x%llx)",
+                         kept, (unsigned long long)newMask);
+            }
+            else
+            {
+                err = GetLastError();
+            }
+            CloseHandle(hProcess);
+        }
+        else
+        {
+            err = GetLastError();
+        }
+        if (actionDesc[0] == L'\0')
+            swprintf(actionDesc, descSize, L"Affinity restriction");
+        break;
+    }
+    case ACTION_CPU_RATE_CAP:
+    {
+        swprintf(actionDesc, descSize, L"CPU rate capped at %lu%% of one core", cfg->cpuRateCapPercent);
+        if (!IsWindows8OrGreater())
+        {
+            LogMessage(L"CPU rate cap for %ls (PID %u) requires Windows 8 or later; action skipped.", exeName, pid);
+            hist->throttleApplied |= (1u << action);
+            return FALSE;
+        }
+        HANDLE hJob = GetOrCreateProcessJob(hist, pid, exeName);
+        if (hJob)
+        {
+            // CpuRateCapPercent is measured against one core, the job rate against the whole machine.
+            PM_JOB_CPU_RATE_CONTROL rate = {0};
+            rate.ControlFlags = PM_JOB_CPU_RATE_CONTROL_ENABLE | PM_JOB_CPU_RATE_CONTROL_HARD_CAP;
+            rate.CpuRate = (cfg->cpuRateCapPercent * 100) / g.machineProcessors;
+            if (rate.CpuRate < 1)
+                rate.CpuRate = 1;
+            ok = SetInformationJobObject(hJob, PM_JOB_OBJECT_CPU_RATE_CONTROL_INFORMATION, &rate, sizeof(rate));
+            if (!ok)
+                err = GetLastError();
+        }
+        else
+        {
+            // GetOrCreateProcessJob already logged the reason; do not retry every tick.
+            hist->throttleApplied |= (1u << action);
+            return FALSE;
+        }
+        break;
+    }
+    case ACTION_MEMORY_CAP:
+    {
+        // Two tiers: a hard working-set maximum makes the memory manager trim and
+        // page the process (soft cap, like memory.high), and a job commit limit makes
+        // further allocations fail (hard cap, like memory.max).
+        SIZE_T softBytes = (SIZE_T)cfg->memThresholdMb * 1024 * 1024;
+        DWORD commitMb = cfg->memCapCommitLimitMb ? cfg->memCapCommitLimitMb : cfg->memThresholdMb * 2;
+        swprintf(actionDesc, descSize, L"Memory capped (working set %lu MB, commit limit %lu MB)",
+                 cfg->memThresholdMb, commitMb);
+
+        HANDLE hProcess = OpenVerifiedProcess(PROCESS_SET_QUOTA, pid, &hist->ftCreate);
+        if (hProcess)
+        {
+            if (!SetProcessWorkingSetSizeEx(hProcess, 1024 * 1024, softBytes,
+                                            QUOTA_LIMITS_HARDWS_MAX_ENABLE | QUOTA_LIMITS_HARDWS_MIN_DISABLE))
+            {
+                DWORD wsErr = GetLastError();
+                LogMessage(L"Failed to set working set limit for %ls (PID %u): %ls (Error %lu); relying on commit limit only.",
+                           exeName, pid, GetErrorDescription(wsErr), wsErr);
+            }
+            CloseHandle(hProcess);
+        }
+
+        HANDLE hJob = GetOrCreateProcessJob(hist, pid, exeName);
+        if (hJob)
+        {
+            JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits;
+            memset(&limits, 0, sizeof(limits));
+            QueryInformationJobObject(hJob, JobObjectExtendedLimitInformation, &limits, sizeof(limits), NULL);
+            limits.BasicLimitInformation.LimitFlags |= JOB_OBJECT_LIMIT_PROCESS_MEMORY;
+            limits.ProcessMemoryLimit = (SIZE_T)commitMb * 1024 * 1024;
+            ok = SetInformationJobObject(hJob, JobObjectExtendedLimitInformation, &limits, sizeof(limits));
+            if (!ok)
+                err = GetLastError();
+        }
+        else
+        {
+            err = GetLastError();
+        }
+        // Escalation is tracked even if only the working-set tier could be applied.
+        hist->memCapTick = GetTickCount64();
+        hist->memCapPressureSince = 0;
+        break;
+    }
+    default:
+        return FALSE;
+    }
+
+    // Mark as applied even on failure so a process we cannot throttle is not retried every tick.
+    hist->throttleApplied |= (1u << action);
+    if (!ok)
+    {
+        LogMessage(L"Failed to throttle process %ls (PID %u) [%ls]: %ls (Error %lu)", exeName, pid, actionDesc, GetErrorDescription(err), err);
+    }
+    return ok;
+}
+
+// Lifts both tiers of a memory cap so the process runs unconstrained again; the cap is
+// re-applied through the normal rule path if the process goes back over the threshold.
+static void ReleaseMemoryCap(PROCESS_HISTORY *hist, DWORD pid, const WCHAR *exeName, const WCHAR *why)
+{
+    HANDLE hProcess = OpenVerifiedProcess(PROCESS_QUERY_LIMITED_INFORMATION | PROCESS_SET_QUOTA, pid, &hist->ftCreate);
+    if (hProcess)
+    {
+        SIZE_T minWs = 0, maxWs = 0;
+        DWORD flags = 0;
+        if (GetProcessWorkingSetSizeEx(hProcess, &minWs, &maxWs, &flags))
+            SetProcessWorkingSetSizeEx(hProcess, minWs, maxWs,
+                                       QUOTA_LIMITS_HARDWS_MAX_DISABLE | QUOTA_LIMITS_HARDWS_MIN_DISABLE);
+        CloseHandle(hProcess);
+    }
+
+    if (hist->hJob)
+    {
+        JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits;
+        memset(&limits, 0, sizeof(limits));
+        if (QueryInformationJobObject(hist->hJob, JobObjectExtendedLimitInformation, &limits, sizeof(limits), NULL))
+        {
+            limits.BasicLimitInformation.LimitFlags &= ~JOB_OBJECT_LIMIT_PROCESS_MEMORY;
+            limits.ProcessMemoryLimit = 0;
+            SetInformationJobObject(hist->hJob, JobObjectExtendedLimitInformation, &limits, sizeof(limits));
+        }
+    }
+
+    hist->memCapTick = 0;
+    hist->memCapPressureSince = 0;
+    hist->throttleApplied &= ~(1u << ACTION_MEMORY_CAP);
+    LogMessage(L"Released memory cap on %ls (PID %u): %ls", exeName, pid, why);
+}
+
+// Tracks reclaim pressure on a memory-capped process and escalates to termination if the
+// cap has not relieved it within MemCapEscalateMs. The cap is released once the process is
+// back under the hysteresis exit level or MemAction no longer asks for it. Returns TRUE if
+// termination was queued.
+static BOOL CheckMemoryCapEscalation(PROCESS_HISTORY *hist, HANDLE hProcess, DWORD pid, const WCHAR *exeName,
+                                     float cpu, const CONFIG *cfg)
+{
+    if (cfg->ruleAction[RULE_MEM] != ACTION_MEMORY_CAP)
+    {
+        ReleaseMemoryCap(hist, pid, exeName, L"MemAction changed");
+        return FALSE;
+    }
+
+    PROCESS_MEMORY_COUNTERS_EX pmc;
+    if (!GetProcessMemoryInfo(hProcess, (PROCESS_MEMORY_COUNTERS *)&pmc, sizeof(pmc)))
+        return FALSE;
+
+    // Private commit is what the process actually demands; the working set alone is held
+    // down by the cap and would look like relief while the process keeps paging.
+    size_t privateMb = pmc.PrivateUsage / (1024 * 1024);
+    size_t workingSetMb = pmc.WorkingSetSize / (1024 * 1024);
+    if ((ULONGLONG)privateMb * 100 <= (ULONGLONG)cfg->memThresholdMb * cfg->hysteresisExitPercent &&
+        (ULONGLONG)workingSetMb * 100 <= (ULONGLONG)cfg->memThresholdMb * cfg->hysteresisExitPercent)
+    {
+        ReleaseMemoryCap(hist, pid, exeName, L"memory back under the hysteresis exit level");
+        return FALSE;
+    }
+
+    // Reclaim pressure: the working set is pinned at the hard maximum, so every new page
+    // costs a trim, and commit is close to the limit, so the process cannot grow its way out.
+    // Raw page fault counts are not used; they include soft and demand-zero faults.
+    ULONGLONG now = GetTickCount64();
+    DWORD commitMb = cfg->memCapCommitLimitMb ? cfg->memCapCommitLimitMb : cfg->memThresholdMb * 2;
+    BOOL pinned = (ULONGLONG)workingSetMb * 100 >= (ULONGLONG)cfg->memThresholdMb * MEM_CAP_PINNED_PERCENT;
+    BOOL commitNear = (ULONGLONG)privateMb * 100 >= (ULONGLONG)commitMb * MEM_CAP_COMMIT_PRESSURE_PERCENT;
+    if (!pinned || !commitNear)
+    {
+        hist->memCapPressureSince = 0;
+        return FALSE;
+    }
+    if (hist->memCapPressureSince == 0)
+    {
+        hist->memCapPressureSince = now;
+        return FALSE;
+    }
+    if (now - hist->memCapPressureSince < cfg->memCapEscalateMs)
+        return FALSE;
+
+    if (hist->terminateAttempts >= TERMINATE_RETRY_LIMIT || hist->terminatePending)
+        return FALSE;
+
+    if (!AllowTermination(RULE_MEM, cfg))
+        return FALSE;
+
+    WCHAR reason[256];
+    swprintf(reason, 256, L"Memory cap did not relieve pressure for %llu s (commit %llu MB of %lu MB, working set %llu MB of %lu MB)",
+             (unsigned long long)((now - hist->memCapPressureSince) / 1000),
+             (unsigned long long)privateMb, commitMb, (unsigned long long)workingSetMb, cfg->memThresholdMb);
+    LogEvent(FALSE, exeName, pid, reason, cpu, workingSetMb, TRUE, StringFromId(hist->pathId));
+    QueueTermination(hist, pid, exeName, cfg->ruleCloseTimeoutMs[RULE_MEM]);
+    return TRUE;
+}
+
+// -------------------- Process Age --------------------
+// Milliseconds since the process was created; MAXULONGLONG if unknown (treated as settled).
+static ULONGLONG GetProcessAgeMs(const PROCESS_HISTORY *hist)
+{
+    if (!hist || (hist->ftCreate.dwLowDateTime == 0 && hist->ftCreate.dwHighDateTime == 0))
+        return MAXULONGLONG;
+
+    FILETIME nowFt;
+    GetSystemTimeAsFileTime(&nowFt);
+    ULARGE_INTEGER created, now;
+    created.LowPart = hist->ftCreate.dwLowDateTime;
+    created.HighPart = hist->ftCreate.dwHighDateTime;
+    now.LowPart = nowFt.dwLowDateTime;
+    now.HighPart = nowFt.dwHighDateTime;
+    return now.QuadPart > created.QuadPart ? (now.QuadPart - created.QuadPart) / 10000 : 0;
+}
+
+// Age-aware threshold: AgeThresholdScalePercent of the threshold when the rule's grace
+// period ends, falling linearly to the configured threshold AgeRampSec later.
+static DWORD ScaleThresholdForAge(DWORD threshold, ULONGLONG ageMs, int rule, const CONFIG *cfg)
+{
+    if (cfg->ageRampSec == 0)
+        return threshold;
+    ULONGLONG rampStart = (ULONGLONG)cfg->ruleGraceSec[rule] * 1000;
+    ULONGLONG rampMs = (ULONGLONG)cfg->ageRampSec * 1000;
+    if (ageMs >= rampStart + rampMs)
+        return threshold;
+
+    double remaining = ageMs <= rampStart ? 1.0 : 1.0 - (double)(ageMs - rampStart) / (double)rampMs;
+    double scale = 1.0 + (cfg->ageThresholdScalePercent - 100) / 100.0 * remaining;
+    double scaled = threshold * scale;
+    return scaled > 0xFFFFFFFF ? 0xFFFFFFFF : (DWORD)scaled;
+}
+
+static void CheckProcessHungAndTerminate(PROCESS_HISTORY *hist, DWORD pid, const WCHAR *exeName, HUNG_PROCESS_NODE *hungList,
+                                         const CONFIG *cfg)
+{
+    if (!IsProcessHung(pid, hist ? &hist->ftCreate : NULL, hungList))
+    {
+        if (hist)
+            hist->terminateAttemptsHung = 0;
+        return;
+    }
+    if (GetProcessAgeMs(hist) < (ULONGLONG)cfg->ruleGraceSec[RULE_HANG] * 1000)
+        return;
+    if (hist && hist->terminatePending)
+        return;
+
+    int attempts = hist ? hist->terminateAttemptsHung : 0;
+    int logSent = hist ? hist->terminateLogSentHung : 0;
+
+    if (attempts >= TERMINATE_RETRY_LIMIT)
+    {
+        if (!logSent && hist)
+        {
+            LogMessage(L"Process %ls (PID %u) is hung but termination attempts exhausted, skipping further attempts", exeName, pid);
+            hist->terminateLogSentHung = 1;
+        }
+        return;
+    }
+
+    NoteViolation();
+    if (!AllowTermination(RULE_HANG, cfg))
+        return;
+
+    QueueTermination(hist, pid, exeName, cfg->ruleCloseTimeoutMs[RULE_HANG]);
+}
+
+// Takes the configured action for a violated rule. Returns TRUE if the process was
+// handed to the action executor for termination.
+static BOOL ApplyRuleAction(PROCESS_HISTORY *hist, DWORD pid, const WCHAR *exeName, const WCHAR *path, int rule,
+                            const WCHAR *reason, float cpu, size_t memMB, BOOL memValid, const CONFIG *cfg,
+                            int *attempts, int *logSent)
+{
+    int action = cfg->ruleAction[rule];
+    if (hist->terminatePending)
+        return FALSE;
+    if (action != ACTION_TERMINATE)
+    {
+        WCHAR actionDesc[128];
+        BOOL alreadyApplied = (hist->throttleApplied & (1u << action)) != 0;
+        if (!alreadyApplied)
+            NoteViolation();
+        if (TryThrottleProcess(hist, pid, exeName, action, cfg, actionDesc, 128) && !alreadyApplied)
+        {
+            LogActionEvent(exeName, pid, reason, actionDesc, cpu, memMB, memValid, path);
+        }
+        return FALSE;
+    }
+
+    if (*attempts >= TERMINATE_RETRY_LIMIT)
+    {
+        if (!*logSent)
+        {
+            LogMessage(L"Process %ls (PID %u) exceeds threshold but termination attempts exhausted, skipping further attempts", exeName, pid);
+            *logSent = 1;
+        }
+        return FALSE;
+    }
+
+    NoteViolation();
+    if (!AllowTermination(rule, cfg))
+        return FALSE;
+
+    LogEvent(FALSE, exeName, pid, reason, cpu, memMB, memValid, path);
+    return QueueTermination(hist, pid, exeName, cfg->ruleCloseTimeoutMs[rule]);
+}
+
+// Table-driven violation state machine. The table gives the next state for each
+// (state, level); dwell times then decide whether a pending transition may complete.
+// Returns TRUE if the rule should be enforced this tick.
+static BOOL AdvanceViolationState(PROCESS_HISTORY *hist, int level, const CONFIG *cfg)
+{
+    static const BYTE next[VSTATE_COUNT][VLEVEL_COUNT] = {
+        /* NORMAL    */ {VSTATE_NORMAL, VSTATE_NORMAL, VSTATE_WARNING},
+        /* WARNING   */ {VSTATE_NORMAL, VSTATE_WARNING, VSTATE_VIOLATING},
+        /* VIOLATING */ {VSTATE_NORMAL, VSTATE_VIOLATING, VSTATE_VIOLATING},
+        /* ACTED     */ {VSTATE_NORMAL, VSTATE_ACTED, VSTATE_ACTED},
+    };
+    ULONGLONG now = GetTickCount64();
+    BYTE state = hist->vstate;
+    BYTE target = next[state][level];
+
+    if (target == VSTATE_WARNING && state == VSTATE_NORMAL)
+    {
+        hist->vstateSince = now;
+        state = VSTATE_WARNING;
+        target = cfg->violationDwellMs == 0 ? VSTATE_VIOLATING : VSTATE_WARNING;
+    }
+    else if (target == VSTATE_VIOLATING && state == VSTATE_WARNING)
+    {
+        if (now - hist->vstateSince < cfg->violationDwellMs)
+            target = VSTATE_WARNING;
+    }
+    else if (target == VSTATE_NORMAL && state >= VSTATE_VIOLATING)
+    {
+        // Recovery needs a continuous clear streak; vstateSince marks its start.
+        if (hist->vstateSince == 0)
+            hist->vstateSince = now;
+        if (now - hist->vstateSince < cfg->recoveryDwellMs)
+            return FALSE;
+    }
+    else if (state >= VSTATE_VIOLATING)
+    {
+        hist->vstateSince = 0; // clear streak broken
+    }
+
+    if (target == VSTATE_NORMAL && state != VSTATE_NORMAL)
+    {
+        hist->terminateAttempts = 0;
+        hist->terminateLogSent = 0;
+    }
+    if (target == VSTATE_VIOLATING && state == VSTATE_WARNING)
+        hist->vstateSince = 0;
+    hist->vstate = target;
+    return level == VLEVEL_OVER && target >= VSTATE_VIOLATING;
+}
+
+static void CheckProcessResourcesAndTerminate(const PROCESS_SAMPLE *sample, DWORD pid, const WCHAR *exeName,
+                                              const CONFIG *cfg, HUNG_PROCESS_NODE *hungList, SCAN_ENTRY *entry)
+{
+    PROCESS_HISTORY *hist = sample->hist;
+    const WCHAR *path = sample->path;
+    float cpu = sample->cpu, rawCpu = sample->rawCpu;
+    DWORD allowedCores = sample->allowedCores;
+    size_t memMB = sample->memMB;
+    BOOL memValid = sample->memValid;
+
+    if (hist->memCapTick != 0 && CheckMemoryCapEscalation(hist, hist->hQuery, pid, exeName, cpu, cfg))
+        return;
+
+    // Quiet path for the bulk of processes: nothing near a limit, no violation state to
+    // unwind and no leak prediction to run. Equivalent to the full path below, which
+    // would find RULE_NONE and leave a NORMAL state machine as it is.
+    if (!sample->nearLimit && hist->vstate == VSTATE_NORMAL && hist->memCapTick == 0 && !cfg->leakDetection &&
+        !IsProcessHung(pid, &hist->ftCreate, hungList))
+    {
+        if (cfg->victimSelection && memValid)
+            LeakTrendAddSample(&hist->leak, memMB);
+        if (entry)
+        {
+            entry->cpu = cpu;
+            entry->memMB = memValid ? memMB : 0;
+            entry->measured = TRUE;
+            entry->hist = hist;
+        }
+        return;
+    }
+
+    BOOL abnormal = FALSE;
+    WCHAR reason[512];
+    BOOL hung = IsProcessHung(pid, &hist->ftCreate, hungList);
+    ULONGLONG ageMs = GetProcessAgeMs(hist);
+    DWORD cpuThreshold = ScaleThresholdForAge(cfg->cpuThresholdPercent, ageMs, RULE_CPU, cfg);
+    DWORD memThreshold = ScaleThresholdForAge(cfg->memThresholdMb, ageMs, RULE_MEM, cfg);
+
+    // Young processes are sampled (so CPU and leak trends are primed) but not enforced.
+    // Grace is per rule, so a CPU rule still in grace does not hide a memory violation.
+    DWORD inGrace = 0;
+    for (int r = 0; r < RULE_COUNT; r++)
+    {
+        if (ageMs < (ULONGLONG)cfg->ruleGraceSec[r] * 1000)
+            inGrace |= 1u << r;
+    }
+    int rule = FormatReason(reason, 512, cpu, cpuThreshold, cfg->cpuNormalization,
+                            memValid, memMB, memThreshold, cfg->memMetric, hung, inGrace);
+
+    // A process that keeps every core it may use busy is starving whatever else shares them,
+    // even when it is far below a machine-wide threshold.
+    if (rule == RULE_NONE && !(inGrace & (1u << RULE_CPU)) && cfg->cpuSaturationPercent &&
+        rawCpu >= (float)cfg->cpuSaturationPercent * (float)allowedCores)
+    {
+        swprintf(reason, 512, L"CPU saturated: %.1f%% of %lu allowed core(s) (threshold %lu%%)",
+                 rawCpu / (float)allowedCores, allowedCores, cfg->cpuSaturationPercent);
+        rule = RULE_CPU;
+    }
+
+    if (rule != RULE_NONE)
+    {
+        abnormal = TRUE;
+    }
+
+    if ((cfg->leakDetection || cfg->victimSelection) && memValid)
+        LeakTrendAddSample(&hist->leak, memMB);
+
+    if (cfg->leakDetection && memValid)
+    {
+        double mbPerMin = 0.0, secondsToLimit = 0.0;
+        if (LeakTrendPredict(&hist->leak, cfg, memMB, &mbPerMin, &secondsToLimit))
+        {
+            if (rule == RULE_NONE)
+            {
+                swprintf(reason, 512, L"Memory leak suspected: growing %.1f MB/min, predicted to reach %lu MB in %.0f s",
+                         mbPerMin, cfg->memThresholdMb, secondsToLimit);
+                if (cfg->leakDetection == 2 && !(inGrace & (1u << RULE_MEM)))
+                {
+                    rule = RULE_MEM;
+                    abnormal = TRUE;
+                }
+                else if (!hist->leak.reported)
+                {
+                    LogMessage(L"%ls: %ls (PID %u), currently %llu MB\n  Path: %ls", reason, exeName, pid,
+                               (unsigned long long)memMB, (path && path[0] != L'\0') ? path : L"Path unavailable");
+                }
+                hist->leak.reported = TRUE;
+            }
+        }
+        else
+        {
+            hist->leak.reported = FALSE;
+        }
+    }
+
+    int level = VLEVEL_CLEAR;
+    if (abnormal)
+        level = VLEVEL_OVER;
+    else if ((double)cpu * 100.0 > (double)cpuThreshold * cfg->hysteresisExitPercent ||
+             (memValid && (double)memMB * 100.0 > (double)memThreshold * cfg->hysteresisExitPercent))
+        level = VLEVEL_ELEVATED;
+    abnormal = AdvanceViolationState(hist, level, cfg);
+
+    if (entry)
+    {
+        entry->cpu = cpu;
+        entry->memMB = memValid ? memMB : 0;
+        entry->measured = TRUE;
+        entry->hist = hist;
+    }
+
+    if (abnormal && rule == RULE_MEM && cfg->victimSelection && entry)
+    {
+        // Scored against the other candidates once the whole snapshot is measured.
+        entry->memCandidate = TRUE;
+        entry->leakOnly = memMB <= cfg->memThresholdMb;
+    }
+    else if (abnormal)
+    {
+        if (ApplyRuleAction(hist, pid, exeName, path, rule, reason, cpu, memMB, memValid, cfg,
+                            &hist->terminateAttempts, &hist->terminateLogSent))
+        {
+            if (entry)
+            {
+                entry->measured = FALSE;
+                entry->hist = NULL;
+            }
+        }
+        else
+        {
+            hist->vstate = VSTATE_ACTED;
+        }
+    }
+}
+
+// -------------------- Process Check Functions --------------------
+static void CheckNormalProcess(const PROCESSENTRY32W *pe, const PROCESS_SAMPLE *sample, const CONFIG *cfg,
+                               HUNG_PROCESS_NODE *hungList, SCAN_ENTRY *entry)
+{
+    if (!sample->valid)
+    {
+        CheckProcessHungAndTerminate(sample->hist, pe->th32ProcessID, pe->szExeFile, hungList, cfg);
+        return;
+    }
+
+    CheckProcessResourcesAndTerminate(sample, pe->th32ProcessID, pe->szExeFile, cfg, hungList, entry);
+}
+
+static void CheckSystemProcess(const PROCESSENTRY32W *pe, const PROCESS_SAMPLE *sample, const CONFIG *cfg,
+                               HUNG_PROCESS_NODE *hungList)
+{
+    const WCHAR *processPath = sample->path;
+    if (IsProcessHung(pe->th32ProcessID, &sample->hist->ftCreate, hungList))
+    {
+        if (ShouldShowBalloonForProcess(sample->hist->nameId, pe->szExeFile))
+        {
+            WCHAR balloonText[512];
+            swprintf(balloonText, 512, L"System process %ls (PID %u) has a hung window.\nPath: %ls\n(This could be normal activity; check the path if concerned.)",
+                     pe->szExeFile, pe->th32ProcessID, processPath);
+            ShowBalloon(L"Suspicious System Process", balloonText, NIIF_WARNING);
+        }
+        LogEvent(TRUE, pe->szExeFile, pe->th32ProcessID, L"Window not responding",
+                 0.0f, 0, FALSE, processPath);
+        return;
+    }
+
+    if (!sample->valid)
     {
-        memMB = pmc.WorkingSetSize / (1024 * 1024);
-        memValid = TRUE;
+        return;
     }
 
-    float avgCpu = CalcAverageCpuUsage(hProcess);
+    float instCpu = sample->cpu;
+    float avgCpu = sample->avgCpu;
     BOOL cpuValid = (avgCpu >= 0);
+    size_t memMB = sample->memMB;
+    BOOL memValid = sample->memValid;
 
     BOOL suspicious = FALSE;
     WCHAR reason[512] = L"";
@@ -1693,7 +4101,7 @@ static void CheckSystemProcess(const PROCESSENTRY32W *pe, const CONFIG *cfg, HUN
 
     if (suspicious)
     {
-        if (ShouldShowBalloonForProcess(pe->szExeFile))
+        if (ShouldShowBalloonForProcess(sample->hist->nameId, pe->szExeFile))
         {
             WCHAR balloonText[512];
             swprintf(balloonText, 512, L"System process %ls (PID %u) is using excessive resources.\nCPU: %.1f%% (inst) / %.1f%% (avg)  Memory: %llu MB\nPath: %ls\n(This could be normal activity; check the path if concerned.)",
@@ -1703,8 +4111,6 @@ static void CheckSystemProcess(const PROCESSENTRY32W *pe, const CONFIG *cfg, HUN
         LogEvent(TRUE, pe->szExeFile, pe->th32ProcessID, reason,
                  (instCpu > 0 ? instCpu : (cpuValid ? avgCpu : 0.0f)), memMB, memValid, processPath);
     }
-
-    CloseHandle(hProcess);
 }
 
 BOOL IsBuiltInExcluded(const WCHAR *fileName, const WCHAR *fullPath)
@@ -1746,34 +4152,876 @@ BOOL IsProcessExcluded(const WCHAR *nameW, const CONFIG *cfg, const WCHAR *path)
         if (_wcsicmp(nameW, cfg->excludeList[i]) == 0)
         {
             return TRUE;
-        }
+        }
+    }
+    return FALSE;
+}
+
+// -------------------- Measurement Stage --------------------
+// Reads everything a decision needs without logging or acting, so it can run on any scan
+// worker. Only the process's own history record is written.
+static void MeasureProcess(const PROCESSENTRY32W *pe, const CONFIG *cfg, PROCESS_SAMPLE *sample, DWORD slot,
+                           SCAN_WORKER *worker)
+{
+    memset(sample, 0, sizeof(PROCESS_SAMPLE));
+    sample->path = L"";
+    sample->kind = SAMPLE_SKIP;
+    SCAN_COUNTERS *c = &g.counters;
+    if (slot != NO_SCAN_SLOT)
+    {
+        c->cpuTime[slot] = c->prevCpuTime[slot] = c->memMB[slot] = 0;
+        c->stamp[slot] = c->prevStamp[slot] = 0;
+        c->cpuScale[slot] = c->cores[slot] = 0.0f;
+    }
+    if (pe->th32ProcessID == GetCurrentProcessId())
+        return;
+
+    // Out of memory, or left behind by MeasureScan: the process is skipped this scan.
+    PROCESS_HISTORY *hist = AcquireHistory(pe, cfg, sample, worker);
+    if (!hist)
+        return;
+    sample->hist = hist;
+    sample->path = StringFromId(hist->pathId);
+
+    if (IsBuiltInExcluded(pe->szExeFile, sample->path))
+        sample->kind = SAMPLE_SYSTEM;
+    else if (!IsProcessExcluded(pe->szExeFile, cfg, sample->path))
+        sample->kind = SAMPLE_NORMAL;
+    else
+        return;
+
+    HANDLE hProcess = hist->hQuery;
+    if (!hProcess)
+        return;
+    sample->valid = TRUE;
+
+    ULONGLONG cpuTime = 0, prevCpuTime = 0;
+    LONGLONG stamp = 0, prevStamp = 0;
+    BOOL cpuRead = ReadCpuCounters(hProcess, hist, &cpuTime, &prevCpuTime, &stamp, &prevStamp);
+    sample->memValid = MeasureProcessMemory(hProcess, cfg, worker, &sample->memMB);
+    sample->allowedCores = g.numProcessors;
+    if (cfg->cpuNormalization == CPU_NORM_ALLOWED || (sample->kind == SAMPLE_NORMAL && cfg->cpuSaturationPercent))
+        sample->allowedCores = GetAllowedProcessorCount(hProcess);
+    if (sample->kind == SAMPLE_SYSTEM)
+    {
+        sample->avgCpu = CalcAverageCpuUsage(hProcess);
+        if (sample->avgCpu >= 0)
+            sample->avgCpu = NormalizeCpu(sample->avgCpu, sample->allowedCores, cfg);
+    }
+
+    float scale = CpuNormScale(sample->allowedCores, cfg);
+    if (slot == NO_SCAN_SLOT)
+    {
+        sample->rawCpu = cpuRead ? CpuPercent(cpuTime - prevCpuTime, stamp - prevStamp) : 0.0f;
+        sample->cpu = sample->rawCpu * scale;
+        sample->nearLimit = TRUE;
+        return;
+    }
+    if (cpuRead)
+    {
+        c->cpuTime[slot] = cpuTime;
+        c->prevCpuTime[slot] = prevCpuTime;
+        c->stamp[slot] = stamp;
+        c->prevStamp[slot] = prevStamp;
+    }
+    c->cpuScale[slot] = scale;
+    c->cores[slot] = (float)sample->allowedCores;
+    c->memMB[slot] = sample->memValid ? sample->memMB : 0;
+}
+
+// Marks the worker as inside a call that may hang. Paired with EndBlockingCall.
+static void BeginBlockingCall(SCAN_WORKER *worker, DWORD pid)
+{
+    worker->pid = pid;
+    InterlockedExchange(&worker->state, SCAN_WORKER_BLOCKED);
+}
+
+// FALSE if MeasureScan left the worker behind meanwhile; the caller must then drop what
+// it measured and touch no scan state.
+static BOOL EndBlockingCall(SCAN_WORKER *worker)
+{
+    return InterlockedCompareExchange(&worker->state, SCAN_WORKER_RUNNING, SCAN_WORKER_BLOCKED) ==
+           SCAN_WORKER_BLOCKED;
+}
+
+// TRUE if a worker MeasureScan left behind is still stuck opening pid, so other workers
+// do not get stuck on the same process.
+static BOOL OrphanedOn(DWORD pid)
+{
+    for (DWORD w = 0; w < g.scanWorkerCount; w++)
+    {
+        const SCAN_WORKER *worker = &g.scanWorkerState[w];
+        if (worker->state == SCAN_WORKER_ORPHANED && worker->pid == pid)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+// Claims SCAN_CHUNK_SIZE entries at a time from a shared cursor until the scan is
+// exhausted, so a worker that draws cheap processes simply takes more chunks. Past the
+// hot entries no new chunk is claimed once the ScanBudgetUs deadline has passed. Entries
+// a worker finishes are marked sampled; the rest of a chunk whose worker was left behind
+// stays unsampled and is deferred by FinishScanSampling.
+static void MeasureScanChunks(const CONFIG *cfg, SCAN_WORKER *worker)
+{
+    for (;;)
+    {
+        if (StageAbandoned())
+            break;
+        if (g.scanBudgetEnd && (DWORD)g.scanNextIndex >= g.scanHotCount)
+        {
+            LARGE_INTEGER now;
+            QueryPerformanceCounter(&now);
+            if (now.QuadPart > g.scanBudgetEnd)
+                break;
+        }
+        DWORD start = (DWORD)InterlockedExchangeAdd(&g.scanNextIndex, SCAN_CHUNK_SIZE);
+        if (start >= g.scanOrderCount)
+            break;
+        DWORD end = start + SCAN_CHUNK_SIZE < g.scanOrderCount ? start + SCAN_CHUNK_SIZE : g.scanOrderCount;
+        for (DWORD k = start; k < end; k++)
+        {
+            DWORD i = (DWORD)g.scanQueue[k];
+            if (g.scanWorkersOrphaned && OrphanedOn(g.scan[i].pe.th32ProcessID))
+                continue;
+            MeasureProcess(&g.scan[i].pe, cfg, &g.scan[i].sample, i, worker);
+            if (worker->state == SCAN_WORKER_ORPHANED)
+                return; // g.scan may already belong to a later scan
+            g.scan[i].sampled = TRUE;
+        }
+    }
+}
+
+// Enters or leaves background processing mode (lowered CPU, I/O and memory priority).
+// Windows only lets a thread switch itself, so every measurement worker calls this with
+// its own state. The monitor thread stays at normal priority: it makes the decisions and
+// holds locks the UI and executor wait on.
+static void SetBackgroundMode(BOOL *current, BOOL wanted)
+{
+    static volatile LONG failureLogged = 0;
+    if (*current == wanted)
+        return;
+    if (SetThreadPriority(GetCurrentThread(), wanted ? THREAD_MODE_BACKGROUND_BEGIN : THREAD_MODE_BACKGROUND_END))
+    {
+        *current = wanted;
+        return;
+    }
+    if (InterlockedExchange(&failureLogged, 1) == 0)
+        LogError(L"Failed to switch scan thread background mode (err %lu)", GetLastError());
+    *current = wanted; // not retried every scan
+}
+
+DWORD WINAPI ScanWorkerThread(LPVOID lpParam)
+{
+    SCAN_WORKER *worker = (SCAN_WORKER *)lpParam;
+    HANDLE waits[2] = {g.hStopEvent, g.hScanWorkSemaphore};
+    BOOL background = FALSE;
+    while (WaitForMultipleObjects(2, waits, FALSE, INFINITE) == WAIT_OBJECT_0 + 1)
+    {
+        SetBackgroundMode(&background, g.scanConfig->backgroundMode);
+        MeasureScanChunks(g.scanConfig, worker);
+        if (worker->state == SCAN_WORKER_ORPHANED)
+        {
+            // MeasureScan already counted this worker as done; just rejoin the pool.
+            InterlockedExchange(&worker->state, SCAN_WORKER_RUNNING);
+            InterlockedDecrement(&g.scanWorkersOrphaned);
+            continue;
+        }
+        if (InterlockedDecrement(&g.scanWorkersBusy) == 0)
+            SetEvent(g.hScanDoneEvent);
+    }
+    return 0;
+}
+
+// Starts pool threads until `wanted` are idle, not counting workers a previous scan left
+// behind; returns how many are available.
+static DWORD EnsureScanWorkers(DWORD wanted)
+{
+    static BOOL failureLogged = FALSE;
+    if (!g.hScanWorkSemaphore || !g.hScanDoneEvent)
+        return 0;
+    DWORD orphaned = (DWORD)g.scanWorkersOrphaned;
+    while (g.scanWorkerCount - orphaned < wanted && g.scanWorkerCount < MAX_SCAN_WORKERS)
+    {
+        HANDLE hThread = CreateThread(NULL, 0, ScanWorkerThread, &g.scanWorkerState[g.scanWorkerCount], 0, NULL);
+        if (!hThread)
+        {
+            if (!failureLogged)
+            {
+                LogError(L"Failed to start scan worker thread (err %lu), continuing with %lu", GetLastError(),
+                         g.scanWorkerCount);
+                failureLogged = TRUE;
+            }
+            break;
+        }
+        g.scanWorkers[g.scanWorkerCount++] = hThread;
+    }
+    DWORD available = g.scanWorkerCount - orphaned;
+    return wanted < available ? wanted : available;
+}
+
+// Once the watchdog abandons measurement, stops waiting for every helper blocked opening
+// a process: it is counted as done, and the entries it had not finished are deferred.
+// Returns TRUE when no helper is left to wait for.
+static BOOL LeaveBlockedWorkers(void)
+{
+    BOOL done = FALSE;
+    for (DWORD w = 0; w < g.scanWorkerCount; w++)
+    {
+        SCAN_WORKER *worker = &g.scanWorkerState[w];
+        if (InterlockedCompareExchange(&worker->state, SCAN_WORKER_ORPHANED, SCAN_WORKER_BLOCKED) !=
+            SCAN_WORKER_BLOCKED)
+            continue;
+        InterlockedIncrement(&g.scanWorkersOrphaned);
+        LogMessage(L"Watchdog: scan worker blocked opening PID %lu, measuring without it", worker->pid);
+        if (InterlockedDecrement(&g.scanWorkersBusy) == 0)
+            done = TRUE;
+    }
+    return done;
+}
+
+// Measures the entries PlanScanSampling put in scanQueue, spread over ScanWorkers threads
+// (the monitor thread is one of them). A helper stuck opening a process is left behind
+// once the watchdog abandons the phase (see LeaveBlockedWorkers). Returns FALSE if the
+// program is stopping before all workers finished.
+static BOOL MeasureScan(const CONFIG *cfg)
+{
+    DWORD participants = cfg->scanWorkers;
+    if (participants == 0)
+        participants = g.numProcessors < AUTO_SCAN_WORKERS ? g.numProcessors : AUTO_SCAN_WORKERS;
+    DWORD chunks = (g.scanOrderCount + SCAN_CHUNK_SIZE - 1) / SCAN_CHUNK_SIZE;
+    if (participants > chunks)
+        participants = chunks;
+    DWORD helpers = participants > 1 ? EnsureScanWorkers(participants - 1) : 0;
+
+    g.scanConfig = cfg;
+    g.scanNextIndex = 0;
+    g.scanWorkersBusy = (LONG)helpers;
+    if (helpers)
+        ReleaseSemaphore(g.hScanWorkSemaphore, (LONG)helpers, NULL);
+    MeasureScanChunks(cfg, &g.scanWorkerState[MONITOR_SCAN_WORKER]);
+    HANDLE waits[2] = {g.hScanDoneEvent, g.hStopEvent};
+    while (helpers)
+    {
+        DWORD wait = WaitForMultipleObjects(2, waits, FALSE, WATCHDOG_POLL_MS);
+        if (wait == WAIT_OBJECT_0)
+            break;
+        if (wait != WAIT_TIMEOUT)
+            return FALSE;
+        if (StageAbandoned() && LeaveBlockedWorkers())
+            break;
+    }
+    return TRUE;
+}
+
+// -------------------- Tiered Sampling --------------------
+// Orders the scan for measurement. Without TieredSampling every entry is measured. With
+// it, hot processes (and new, hung or unopened ones) come first and are always measured,
+// then warm processes whose turn has come, then the next TierColdBatch cold processes in
+// enumeration order, continuing where the previous scan stopped. ScanBudgetProcesses
+// and ScanBudgetUs only cut the warm and cold part.
+static void PlanScanSampling(const CONFIG *cfg, HUNG_PROCESS_NODE *hungList)
+{
+    DWORD n = g.scanCount;
+    DWORD count = 0;
+    g.scanTiered = cfg->tieredSampling;
+    g.scanBudgetEnd = 0;
+    if (!cfg->tieredSampling)
+    {
+        for (DWORD i = 0; i < n; i++)
+            g.scanQueue[i] = (int)i;
+        g.scanOrderCount = g.scanHotCount = n;
+        return;
+    }
+
+    g.tierScan++;
+    DWORD coldCount = 0;
+    for (DWORD i = 0; i < n; i++)
+    {
+        SCAN_ENTRY *e = &g.scan[i];
+        PROCESS_HISTORY *hist = LookupHistory(e->pe.th32ProcessID);
+        e->hist = hist;
+        e->tier = TIER_HOT;
+        if (hist && hist->hQuery && !IsProcessHung(e->pe.th32ProcessID, &hist->ftCreate, hungList))
+            e->tier = hist->tier;
+        e->deferred = e->tier != TIER_HOT;
+        if (!e->deferred)
+            g.scanQueue[count++] = (int)i;
+        else if (e->tier == TIER_COLD)
+            coldCount++;
+    }
+    g.scanHotCount = count;
+
+    for (DWORD i = 0; i < n; i++)
+    {
+        SCAN_ENTRY *e = &g.scan[i];
+        if (e->tier == TIER_WARM && g.tierScan - e->hist->sampledScan >= cfg->tierWarmEvery)
+        {
+            e->deferred = FALSE;
+            g.scanQueue[count++] = (int)i;
+        }
+    }
+
+    g.scanColdCount = coldCount;
+    if (coldCount)
+    {
+        // Queued from the cursor on, wrapping once, so a budget cut drops the end of the
+        // batch and FinishScanSampling can advance the cursor past what was measured.
+        DWORD cursor = g.coldCursor % coldCount;
+        DWORD batch = cfg->tierColdBatch < coldCount ? cfg->tierColdBatch : coldCount;
+        DWORD taken = 0;
+        for (int wrapped = 0; wrapped < 2 && taken < batch; wrapped++)
+        {
+            DWORD coldIndex = 0;
+            for (DWORD i = 0; i < n && taken < batch; i++)
+            {
+                SCAN_ENTRY *e = &g.scan[i];
+                if (e->tier != TIER_COLD)
+                    continue;
+                if ((coldIndex < cursor) == wrapped)
+                {
+                    e->deferred = FALSE;
+                    g.scanQueue[count++] = (int)i;
+                    taken++;
+                }
+                coldIndex++;
+            }
+        }
+        g.coldCursor = cursor;
+    }
+
+    // The budget counts warm and cold entries only; hot ones before it are never cut.
+    if (cfg->scanBudgetProcesses && count - g.scanHotCount > cfg->scanBudgetProcesses)
+    {
+        DWORD keep = g.scanHotCount + cfg->scanBudgetProcesses;
+        for (DWORD k = keep; k < count; k++)
+            g.scan[g.scanQueue[k]].deferred = TRUE;
+        count = keep;
+    }
+    g.scanOrderCount = count;
+
+    if (cfg->scanBudgetUs)
+    {
+        LARGE_INTEGER now;
+        QueryPerformanceCounter(&now);
+        g.scanBudgetEnd = now.QuadPart + (LONGLONG)cfg->scanBudgetUs * g.perfFrequency / 1000000;
+    }
+}
+
+// After measurement: entries the budget or the watchdog cut are deferred too, and every deferred process
+// keeps its history record and stands in the tree totals with its last sample.
+static void FinishScanSampling(void)
+{
+    DWORD done = 0;
+    for (DWORD k = 0; k < g.scanOrderCount; k++)
+    {
+        SCAN_ENTRY *e = &g.scan[g.scanQueue[k]];
+        if (!e->sampled)
+        {
+            e->deferred = TRUE;
+            continue;
+        }
+        done++;
+        // The decision stage sets hist again; the planning lookup may be replaced.
+        e->hist = NULL;
+        g.scanSampled[e->tier]++;
+    }
+    // Cold processes the budget or the watchdog cut get their turn on the next scan.
+    if (g.scanTiered && g.scanColdCount)
+        g.coldCursor = (g.coldCursor + g.scanSampled[TIER_COLD]) % g.scanColdCount;
+    if (done == g.scanCount)
+        return;
+
+    for (DWORD i = 0; i < g.scanCount; i++)
+    {
+        SCAN_ENTRY *e = &g.scan[i];
+        if (!e->deferred)
+            continue;
+        g.scanDeferred++;
+        // Without TieredSampling only an abandoned measurement leaves entries behind, and
+        // those were never looked up.
+        PROCESS_HISTORY *hist = g.scanTiered ? e->hist : LookupHistory(e->pe.th32ProcessID);
+        e->hist = hist;
+        if (!hist)
+            continue; // new process cut by the budget; measured on a later scan
+        hist->seen = TRUE;
+        if (hist->kind == SAMPLE_NORMAL)
+        {
+            e->eligible = TRUE;
+            e->measured = TRUE;
+            e->cpu = hist->lastCpu;
+            e->memMB = hist->lastMemMB;
+        }
+        else
+        {
+            e->hist = NULL;
+        }
+    }
+}
+
+// Moves every process measured by this scan into its tier for the next ones.
+static void UpdateSampleTiers(const CONFIG *cfg)
+{
+    if (!cfg->tieredSampling)
+        return;
+    const float hotCpu = (float)cfg->cpuThresholdPercent * (float)cfg->tierHotPercent / 100.0f;
+    const float warmCpu = (float)cfg->cpuThresholdPercent * (float)cfg->tierWarmPercent / 100.0f;
+    const size_t hotMem = (size_t)cfg->memThresholdMb * cfg->tierHotPercent / 100;
+    const size_t warmMem = (size_t)cfg->memThresholdMb * cfg->tierWarmPercent / 100;
+    for (DWORD i = 0; i < g.scanCount; i++)
+    {
+        const PROCESS_SAMPLE *sample = &g.scan[i].sample;
+        PROCESS_HISTORY *h = sample->hist;
+        if (!h)
+            continue; // deferred, or no record
+        h->kind = (BYTE)sample->kind;
+        h->sampledScan = g.tierScan;
+        if (!sample->valid)
+        {
+            // Excluded: only revisited in case the exclude list changes.
+            h->tier = TIER_COLD;
+            continue;
+        }
+        h->lastCpu = sample->cpu;
+        h->lastMemMB = sample->memValid ? sample->memMB : 0;
+        if (sample->nearLimit || h->vstate != VSTATE_NORMAL || h->memCapTick || h->throttleApplied ||
+            h->terminatePending || sample->cpu >= hotCpu || h->lastMemMB >= hotMem)
+            h->tier = TIER_HOT;
+        else if (sample->cpu >= warmCpu || h->lastMemMB >= warmMem)
+            h->tier = TIER_WARM;
+        else
+            h->tier = TIER_COLD;
+    }
+}
+
+// Turns the counters of every measured slot into CPU% and flags the processes that could
+// trip a rule. The first two loops are branch-free over the parallel arrays, so the
+// compiler can vectorize them; the last is a scalar pass that skips invalid samples and
+// copies the results into the per-entry samples the decision stage reads. Age scaling
+// only raises thresholds, so the configured ones are the lowest that can apply. Returns the number of flagged processes; the number of normal
+// processes within AdaptiveNearPercent of a threshold goes to g.scanApproaching.
+static DWORD ComputeScanUsage(const CONFIG *cfg)
+{
+    SCAN_COUNTERS *c = &g.counters;
+    DWORD n = g.scanCount;
+    const double percentPerTick = (double)g.perfFrequency * 1e-5;
+    for (DWORD i = 0; i < n; i++)
+    {
+        double elapsed = (double)(c->stamp[i] - c->prevStamp[i]);
+        double used = (double)(c->cpuTime[i] - c->prevCpuTime[i]);
+        float raw = elapsed > 0.0 ? (float)(used * percentPerTick / elapsed) : 0.0f;
+        c->rawCpu[i] = raw;
+        c->cpu[i] = raw * c->cpuScale[i];
+    }
+
+    const float cpuLimit = (float)cfg->cpuThresholdPercent;
+    const ULONGLONG memLimit = cfg->memThresholdMb;
+    const float saturation = (float)cfg->cpuSaturationPercent;
+    const int checkSaturation = cfg->cpuSaturationPercent != 0;
+    for (DWORD i = 0; i < n; i++)
+    {
+        int saturated = checkSaturation & (c->cores[i] > 0.0f) & (c->rawCpu[i] >= saturation * c->cores[i]);
+        c->nearLimit[i] = (BYTE)((c->cpu[i] > cpuLimit) | (c->memMB[i] > memLimit) | saturated);
+    }
+
+    const float cpuNear = cpuLimit * (float)cfg->adaptiveNearPercent / 100.0f;
+    const ULONGLONG memNear = memLimit * cfg->adaptiveNearPercent / 100;
+    DWORD flagged = 0, approaching = 0;
+    for (DWORD i = 0; i < n; i++)
+    {
+        PROCESS_SAMPLE *sample = &g.scan[i].sample;
+        if (!sample->valid)
+            continue;
+        sample->rawCpu = c->rawCpu[i];
+        sample->cpu = c->cpu[i];
+        sample->nearLimit = c->nearLimit[i];
+        flagged += c->nearLimit[i];
+        // System processes are never acted on, so they do not speed up the scan.
+        if (sample->kind == SAMPLE_NORMAL)
+            approaching += c->nearLimit[i] | (c->cpu[i] > cpuNear) | (c->memMB[i] > memNear);
+    }
+    g.scanApproaching = approaching;
+    g.scanMeasured = TRUE;
+    return flagged;
+}
+
+// -------------------- Decision Stage --------------------
+// Runs on the monitor thread in enumeration order, so logs and actions stay deterministic
+// however the measurement was split.
+static void CheckProcess(const PROCESSENTRY32W *pe, const PROCESS_SAMPLE *sample, const CONFIG *cfg,
+                         HUNG_PROCESS_NODE *hungList, SCAN_ENTRY *entry)
+{
+    if (sample->kind == SAMPLE_SYSTEM)
+    {
+        CheckSystemProcess(pe, sample, cfg, hungList);
+        return;
+    }
+    if (sample->kind != SAMPLE_NORMAL)
+    {
+        return;
+    }
+
+    if (entry)
+        entry->eligible = TRUE;
+    CheckNormalProcess(pe, sample, cfg, hungList, entry);
+}
+
+// -------------------- Memory Victim Selection --------------------
+typedef struct _VICTIM_CANDIDATE
+{
+    double score;
+    int index; // into g.scan
+} VICTIM_CANDIDATE;
+
+static void VictimHeapSiftDown(VICTIM_CANDIDATE *heap, int count, int i)
+{
+    for (;;)
+    {
+        int smallest = i, l = 2 * i + 1, r = 2 * i + 2;
+        if (l < count && heap[l].score < heap[smallest].score)
+            smallest = l;
+        if (r < count && heap[r].score < heap[smallest].score)
+            smallest = r;
+        if (smallest == i)
+            return;
+        VICTIM_CANDIDATE tmp = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+// Badness of a memory-rule candidate, in per-mille of physical memory like the Linux OOM killer,
+// adjusted for growth, rule priority, foreground ownership and age. Rule priority ranks a
+// process breaking both the CPU and memory rules above one breaking only the memory rule,
+// and both above a process that is only predicted to leak.
+static double ScoreMemoryVictim(const SCAN_ENTRY *e, const CONFIG *cfg, DWORD foregroundPid, const FILETIME *now)
+{
+    double totalMb = g.pressure.totalPhysMb ? (double)g.pressure.totalPhysMb : 1.0;
+    double growthMb = LeakTrendGrowthMbPerMin(&e->hist->leak) * VICTIM_GROWTH_MINUTES;
+    double score = ((double)e->memMB + growthMb) * 1000.0 / totalMb;
+
+    if (e->leakOnly)
+        score *= VICTIM_LEAK_ONLY_WEIGHT;
+    else if (e->cpu > cfg->cpuThresholdPercent)
+        score *= VICTIM_CPU_RULE_WEIGHT;
+    if (e->pe.th32ProcessID == foregroundPid)
+        score *= VICTIM_FOREGROUND_WEIGHT;
+
+    ULARGE_INTEGER created, current;
+    created.LowPart = e->hist->ftCreate.dwLowDateTime;
+    created.HighPart = e->hist->ftCreate.dwHighDateTime;
+    current.LowPart = now->dwLowDateTime;
+    current.HighPart = now->dwHighDateTime;
+    if (created.QuadPart != 0 && current.QuadPart > created.QuadPart &&
+        (current.QuadPart - created.QuadPart) / 10000 < VICTIM_YOUNG_AGE_MS)
+        score *= VICTIM_YOUNG_WEIGHT;
+    return score;
+}
+
+// Acts on the VictimMaxPerScan worst memory-rule candidates, and only while memory is
+// actually short. Remaining candidates are reconsidered on the next scan.
+static void SelectMemoryVictims(const CONFIG *cfg)
+{
+    if (!g.pressure.memoryStressed)
+        return;
+
+    VICTIM_CANDIDATE heap[MAX_VICTIM_MAX_PER_SCAN];
+    int k = (int)cfg->victimMaxPerScan;
+    int count = 0;
+
+    HWND hFg = GetForegroundWindow();
+    DWORD foregroundPid = 0;
+    if (hFg)
+        GetWindowThreadProcessId(hFg, &foregroundPid);
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+
+    // Bounded min-heap: O(n log k) partial selection of the k highest scores.
+    for (DWORD i = 0; i < g.scanCount; i++)
+    {
+        SCAN_ENTRY *e = &g.scan[i];
+        if (!e->memCandidate || !e->hist)
+            continue;
+        double score = ScoreMemoryVictim(e, cfg, foregroundPid, &now);
+        if (count < k)
+        {
+            heap[count].score = score;
+            heap[count].index = (int)i;
+            count++;
+            if (count == k)
+            {
+                for (int j = k / 2 - 1; j >= 0; j--)
+                    VictimHeapSiftDown(heap, count, j);
+            }
+        }
+        else if (score > heap[0].score)
+        {
+            heap[0].score = score;
+            heap[0].index = (int)i;
+            VictimHeapSiftDown(heap, count, 0);
+        }
+    }
+
+    for (int j = 0; j < count; j++)
+    {
+        SCAN_ENTRY *e = &g.scan[heap[j].index];
+        DWORD pid = e->pe.th32ProcessID;
+        const WCHAR *path = StringFromId(e->hist->pathId);
+
+        WCHAR reason[512];
+        swprintf(reason, 512, L"Memory victim (score %.0f, memory load %lu%%, commit %lu%%): %llu MB%ls, growing %.1f MB/min",
+                 heap[j].score, g.pressure.memoryPercent, g.pressure.commitPercent, (unsigned long long)e->memMB,
+                 e->leakOnly ? L" (predicted leak)" : L"", LeakTrendGrowthMbPerMin(&e->hist->leak));
+        if (ApplyRuleAction(e->hist, pid, e->pe.szExeFile, path, RULE_MEM, reason, e->cpu, e->memMB, TRUE, cfg,
+                            &e->hist->terminateAttempts, &e->hist->terminateLogSent))
+        {
+            e->measured = FALSE;
+            e->hist = NULL;
+        }
+        else
+        {
+            e->hist->vstate = VSTATE_ACTED;
+        }
+    }
+}
+
+// -------------------- Process Tree Aggregation --------------------
+static BOOL EnsureScanCapacity(DWORD needed)
+{
+    if (needed <= g.scanCapacity)
+        return TRUE;
+
+    DWORD newCapacity = g.scanCapacity ? g.scanCapacity * 2 : SCAN_INITIAL_CAPACITY;
+    while (newCapacity < needed)
+        newCapacity *= 2;
+
+    InterlockedIncrement(&g.scanHeapAllocs);
+    SCAN_ENTRY *newScan = (SCAN_ENTRY *)realloc(g.scan, newCapacity * sizeof(SCAN_ENTRY));
+    if (!newScan)
+        return FALSE;
+    g.scan = newScan;
+
+    InterlockedIncrement(&g.scanHeapAllocs);
+    int *newQueue = (int *)realloc(g.scanQueue, newCapacity * sizeof(int));
+    if (!newQueue)
+        return FALSE;
+    g.scanQueue = newQueue;
+
+    InterlockedIncrement(&g.scanHeapAllocs);
+    int *newTable = (int *)realloc(g.scanPidTable, newCapacity * 2 * sizeof(int));
+    if (!newTable)
+        return FALSE;
+    g.scanPidTable = newTable;
+    g.scanPidTableSize = newCapacity * 2;
+
+    // Counters are rewritten by every scan, so there is nothing to carry over.
+    size_t wide = newCapacity * sizeof(ULONGLONG);
+    size_t narrow = newCapacity * sizeof(float);
+    BYTE *block = (BYTE *)CountedAlloc(5 * wide + 4 * narrow + newCapacity);
+    if (!block)
+        return FALSE;
+    free(g.counters.block);
+    g.counters.block = block;
+    g.counters.cpuTime = (ULONGLONG *)block;
+    g.counters.prevCpuTime = (ULONGLONG *)(block + wide);
+    g.counters.stamp = (LONGLONG *)(block + 2 * wide);
+    g.counters.prevStamp = (LONGLONG *)(block + 3 * wide);
+    g.counters.memMB = (ULONGLONG *)(block + 4 * wide);
+    g.counters.cpuScale = (float *)(block + 5 * wide);
+    g.counters.cores = (float *)(block + 5 * wide + narrow);
+    g.counters.rawCpu = (float *)(block + 5 * wide + 2 * narrow);
+    g.counters.cpu = (float *)(block + 5 * wide + 3 * narrow);
+    g.counters.nearLimit = block + 5 * wide + 4 * narrow;
+
+    g.scanCapacity = newCapacity;
+    return TRUE;
+}
+
+static int FindScanIndex(DWORD pid)
+{
+    DWORD mask = g.scanPidTableSize - 1;
+    // Windows PIDs are multiples of 4
+    for (DWORD slot = ((pid >> 2) * 2654435761u) & mask;; slot = (slot + 1) & mask)
+    {
+        int idx = g.scanPidTable[slot];
+        if (idx < 0 || g.scan[idx].pe.th32ProcessID == pid)
+            return idx;
+    }
+}
+
+// Links every entry to its parent and computes subtree CPU/memory totals in a single
+// bottom-up pass (children are folded into a parent once all of them are done).
+static void AggregateProcessTree(void)
+{
+    DWORD count = g.scanCount;
+    DWORD mask = g.scanPidTableSize - 1;
+    for (DWORD i = 0; i < g.scanPidTableSize; i++)
+        g.scanPidTable[i] = -1;
+
+    for (DWORD i = 0; i < count; i++)
+    {
+        SCAN_ENTRY *e = &g.scan[i];
+        DWORD slot = ((e->pe.th32ProcessID >> 2) * 2654435761u) & mask;
+        while (g.scanPidTable[slot] >= 0)
+            slot = (slot + 1) & mask;
+        g.scanPidTable[slot] = (int)i;
+
+        e->parentIndex = -1;
+        e->pendingChildren = 0;
+        e->treeCpu = e->measured ? e->cpu : 0.0f;
+        e->treeMemMB = e->measured ? e->memMB : 0;
+        e->treeCount = 1;
+    }
+
+    for (DWORD i = 0; i < count; i++)
+    {
+        SCAN_ENTRY *e = &g.scan[i];
+        DWORD parentPid = e->pe.th32ParentProcessID;
+        if (parentPid == e->pe.th32ProcessID)
+            continue;
+        int p = FindScanIndex(parentPid);
+        if (p < 0)
+            continue;
+        // The parent may have exited and its PID been reused by a younger process.
+        PROCESS_HISTORY *ph = g.scan[p].hist;
+        if (e->hist && ph && (e->hist->ftCreate.dwHighDateTime | e->hist->ftCreate.dwLowDateTime) != 0 &&
+            CompareFileTime(&ph->ftCreate, &e->hist->ftCreate) > 0)
+            continue;
+        e->parentIndex = p;
+        g.scan[p].pendingChildren++;
+    }
+
+    DWORD head = 0, tail = 0;
+    for (DWORD i = 0; i < count; i++)
+    {
+        if (g.scan[i].pendingChildren == 0)
+            g.scanQueue[tail++] = (int)i;
+    }
+    while (head < tail)
+    {
+        SCAN_ENTRY *e = &g.scan[g.scanQueue[head++]];
+        if (e->parentIndex < 0)
+            continue;
+        SCAN_ENTRY *parent = &g.scan[e->parentIndex];
+        parent->treeCpu += e->treeCpu;
+        parent->treeMemMB += e->treeMemMB;
+        parent->treeCount += e->treeCount;
+        if (--parent->pendingChildren == 0)
+            g.scanQueue[tail++] = e->parentIndex;
+    }
+}
+
+// Shells, terminal hosts and the desktop start unrelated work on the user's behalf, so the
+// sum over everything below them is not one workload.
+static BOOL IsShellProcess(const WCHAR *fileName)
+{
+    static const WCHAR *shellNames[] = {
+        L"explorer.exe", L"cmd.exe", L"powershell.exe", L"powershell_ise.exe", L"pwsh.exe",
+        L"conhost.exe", L"OpenConsole.exe", L"WindowsTerminal.exe", L"wt.exe",
+        L"bash.exe", L"sh.exe", L"mintty.exe", L"wsl.exe", L"wslhost.exe",
+        NULL};
+
+    for (int i = 0; shellNames[i] != NULL; i++)
+    {
+        if (_wcsicmp(fileName, shellNames[i]) == 0)
+            return TRUE;
     }
     return FALSE;
 }
 
-static void CheckProcess(const PROCESSENTRY32W *pe, const CONFIG *cfg, HUNG_PROCESS_NODE *hungList)
+static BOOL IsTreeCandidate(const SCAN_ENTRY *e, const CONFIG *cfg)
 {
-    if (pe->th32ProcessID == GetCurrentProcessId())
-        return;
+    if (!e->eligible || !e->measured || !e->hist || e->treeCount < 2)
+        return FALSE;
+    // A root that violates on its own was already handled by the per-process rules.
+    if (e->cpu > cfg->cpuThresholdPercent || e->memMB > cfg->memThresholdMb)
+        return FALSE;
+    return !IsShellProcess(e->pe.szExeFile);
+}
 
-    WCHAR exeNameW[MAX_PATH_LEN];
-    wcsncpy_s(exeNameW, MAX_PATH_LEN, pe->szExeFile, _TRUNCATE);
+// Subtree total relative to the tree limits (a limit of 0 does not count).
+static float TreeLoad(const SCAN_ENTRY *e, DWORD cpuLimit, DWORD memLimit)
+{
+    float load = cpuLimit ? e->treeCpu / cpuLimit : 0.0f;
+    if (memLimit && (float)e->treeMemMB / memLimit > load)
+        load = (float)e->treeMemMB / memLimit;
+    return load;
+}
 
-    WCHAR pathBuf[INTERNAL_PATH_BUFFER_SIZE] = L"";
-    GetProcessPathW(pe->th32ProcessID, pathBuf, INTERNAL_PATH_BUFFER_SIZE);
+// Applies the CPU/memory rules to whole process trees, taking the action on the tree root.
+// Roots are eligible processes whose parent is not eligible. Shells are never roots: below
+// a shell only the heaviest subtree is judged, so one busy build does not condemn the
+// terminal or every other command started from it.
+static void CheckProcessTrees(const CONFIG *cfg)
+{
+    DWORD cpuLimit = cfg->treeCpuThresholdPercent;
+    DWORD memLimit = cfg->treeMemThresholdMb;
+    if (!cpuLimit && !memLimit)
+        return;
 
-    if (IsBuiltInExcluded(exeNameW, pathBuf))
+    // The queue is free once the totals are summed; slot p holds the heaviest child of shell p.
+    for (DWORD i = 0; i < g.scanCount; i++)
+        g.scanQueue[i] = -1;
+    for (DWORD i = 0; i < g.scanCount; i++)
     {
-        CheckSystemProcess(pe, cfg, hungList);
-        return;
+        SCAN_ENTRY *e = &g.scan[i];
+        int p = e->parentIndex;
+        if (p < 0 || !IsTreeCandidate(e, cfg) || !IsShellProcess(g.scan[p].pe.szExeFile))
+            continue;
+        int best = g.scanQueue[p];
+        if (best < 0 || TreeLoad(e, cpuLimit, memLimit) > TreeLoad(&g.scan[best], cpuLimit, memLimit))
+            g.scanQueue[p] = (int)i;
     }
 
-    if (IsProcessExcluded(exeNameW, cfg, pathBuf))
+    for (DWORD i = 0; i < g.scanCount; i++)
     {
-        return;
-    }
+        SCAN_ENTRY *e = &g.scan[i];
+        if (!IsTreeCandidate(e, cfg))
+            continue;
+        int p = e->parentIndex;
+        if (p >= 0 && g.scanQueue[p] >= 0)
+        {
+            if (g.scanQueue[p] != (int)i)
+                continue;
+        }
+        else if (p >= 0 && g.scan[p].eligible)
+        {
+            continue;
+        }
+
+        WCHAR reason[512];
+        int rule = RULE_NONE;
+        if (cpuLimit && e->treeCpu > cpuLimit)
+        {
+            swprintf(reason, 512, L"High process-tree CPU: %.1f%% across %lu processes (threshold %lu%%)",
+                     e->treeCpu, e->treeCount, cpuLimit);
+            rule = RULE_CPU;
+        }
+        else if (memLimit && e->treeMemMB > memLimit)
+        {
+            swprintf(reason, 512, L"High process-tree memory: %llu MB across %lu processes (threshold %lu MB)",
+                     (unsigned long long)e->treeMemMB, e->treeCount, memLimit);
+            rule = RULE_MEM;
+        }
+
+        PROCESS_HISTORY *hist = e->hist;
+        if (rule == RULE_NONE)
+        {
+            hist->terminateAttemptsTree = 0;
+            hist->terminateLogSentTree = 0;
+            continue;
+        }
 
-    CheckNormalProcess(pe, cfg, hungList);
+        const WCHAR *path = StringFromId(hist->pathId);
+        if (ApplyRuleAction(hist, e->pe.th32ProcessID, e->pe.szExeFile, path, rule, reason,
+                            e->treeCpu, e->treeMemMB, TRUE, cfg,
+                            &hist->terminateAttemptsTree, &hist->terminateLogSentTree))
+        {
+            e->hist = NULL;
+            e->measured = FALSE;
+        }
+    }
 }
 
 // -------------------- Configuration File Change Detection --------------------
@@ -1803,7 +5051,7 @@ BOOL CheckConfigFileChanged(void)
     if (!success)
         return FALSE;
 
-    EnterCriticalSection(&g.csConfig);
+    EnterSharedLock(&g.csConfig);
     BOOL changed = (CompareFileTime(&ftWrite, &g.configLastWrite) != 0);
     LeaveCriticalSection(&g.csConfig);
     return changed;
@@ -1811,7 +5059,7 @@ BOOL CheckConfigFileChanged(void)
 
 void UpdateConfigLastWrite(void)
 {
-    EnterCriticalSection(&g.csConfig);
+    EnterSharedLock(&g.csConfig);
     WCHAR configPath[MAX_LONG_PATH];
     wcscpy_s(configPath, MAX_LONG_PATH, g.exeDir);
     wcscat_s(configPath, MAX_LONG_PATH, L"\\");
@@ -1850,12 +5098,16 @@ static void HandleConfigReload(ULONGLONG *lastConfigCheck, ULONGLONG *lastConfig
             {
                 CreateDefaultConfig();
             }
+            int oldMetric = g.config.memMetric;
             BOOL loadSuccess = LoadConfig();
             if (loadSuccess)
             {
                 UpdateConfigLastWrite();
                 LogMessage(L"Configuration reloaded from file.");
                 g.configLoadFailed = 0;
+                // Cached query handles were opened without the rights the walk needs.
+                if (g.config.memMetric == MEM_METRIC_PRIVATE_WS && oldMetric != MEM_METRIC_PRIVATE_WS)
+                    ResetAllHistory();
             }
             else
             {
@@ -1876,12 +5128,295 @@ static void HandleConfigReload(ULONGLONG *lastConfigCheck, ULONGLONG *lastConfig
     }
 }
 
+// -------------------- Stall Watchdog --------------------
+// Milliseconds from QueryPerformanceCounter. Unlike GetTickCount64 it is not quantized
+// to the 15.6 ms timer tick, so lateness below one timer tick is still visible.
+static ULONGLONG MonotonicMs(void)
+{
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    ULONGLONG c = (ULONGLONG)counter.QuadPart;
+    ULONGLONG f = (ULONGLONG)g.perfFrequency;
+    return c / f * 1000 + c % f * 1000 / f;
+}
+
+static void RecordPhaseLatency(int phase, DWORD ms)
+{
+    PHASE_STATS *ps = &g.phaseStats[phase];
+    int bucket = 0;
+    while (bucket < LATENCY_BUCKETS - 1 && (1u << bucket) <= ms)
+        bucket++;
+    ps->buckets[bucket]++;
+    ps->count++;
+    if (ms > ps->maxMs)
+        ps->maxMs = ms;
+}
+
+// Closes the current phase into its histogram and publishes the new one. Monitor
+// thread only.
+static void EnterPhase(int phase)
+{
+    HEARTBEAT *hb = &g.heartbeat;
+    ULONGLONG now = MonotonicMs();
+    if (hb->phase != PHASE_WAIT)
+        RecordPhaseLatency(hb->phase, (DWORD)(now - hb->since));
+    InterlockedIncrement(&hb->seq);
+    hb->phase = phase;
+    hb->pid = 0;
+    hb->since = now;
+    InterlockedIncrement(&hb->seq);
+}
+
+// TRUE once the watchdog has given up on the phase the monitor thread is in. Long loops
+// of the abandonable phases (hung window scan, measurement) poll this and stop early; the
+// next tick runs the phase again from the start.
+static BOOL StageAbandoned(void)
+{
+    LONG seq = g.abandonSeq;
+    return seq != 0 && seq == g.heartbeat.seq;
+}
+
+// Publishes the process the decision stage is working on. Monitor thread only.
+static void EnterDecision(DWORD pid)
+{
+    InterlockedExchange64(&g.heartbeat.pidSince, (LONGLONG)MonotonicMs());
+    InterlockedExchange(&g.heartbeat.pid, (LONG)pid);
+}
+
+// Takes the process the watchdog found the decision stage stuck on, so later ticks skip
+// it for DECIDE_STALL_SKIP_MS instead of stalling on it again. The rest of the stage,
+// victim selection and tree checks included, always runs. Monitor thread only.
+static void NoteStalledDecision(void)
+{
+    DWORD pid = (DWORD)InterlockedExchange(&g.stalledPid, 0);
+    PROCESS_HISTORY *hist = pid ? LookupHistory(pid) : NULL;
+    if (!hist)
+        return;
+    hist->decideSkipUntil = GetTickCount64() + DECIDE_STALL_SKIP_MS;
+    LogMessage(L"Watchdog: skipping %ls (PID %lu) in the decision stage for %lu s", StringFromId(hist->nameId), pid,
+               (unsigned long)(DECIDE_STALL_SKIP_MS / 1000));
+}
+
+// Logs a watchdog message without ever waiting on csLog: if the monitor thread holds the
+// log (possibly stuck inside it), the message is parked for FlushWatchdogReport instead,
+// so stall detection keeps running whatever the logger is doing.
+static void WatchdogReport(const WCHAR *text)
+{
+    if (TryEnterCriticalSection(&g.csLog))
+    {
+        LogMessage(L"%ls", text);
+        LeaveCriticalSection(&g.csLog);
+        return;
+    }
+    if (InterlockedCompareExchange(&g.watchdogReportState, WATCHDOG_REPORT_WRITING, WATCHDOG_REPORT_EMPTY) !=
+        WATCHDOG_REPORT_EMPTY)
+    {
+        InterlockedIncrement(&g.watchdogReportsLost);
+        return;
+    }
+    wcscpy_s(g.watchdogReport, 256, text);
+    InterlockedExchange(&g.watchdogReportState, WATCHDOG_REPORT_READY);
+}
+
+// Writes the report the watchdog parked while the log was busy. Monitor thread only.
+static void FlushWatchdogReport(void)
+{
+    if (InterlockedCompareExchange(&g.watchdogReportState, WATCHDOG_REPORT_READY, WATCHDOG_REPORT_READY) ==
+        WATCHDOG_REPORT_READY)
+    {
+        WCHAR text[256];
+        wcscpy_s(text, 256, g.watchdogReport);
+        InterlockedExchange(&g.watchdogReportState, WATCHDOG_REPORT_EMPTY);
+        LogMessage(L"%ls (reported late, the log was busy)", text);
+    }
+    LONG lost = InterlockedExchange(&g.watchdogReportsLost, 0);
+    if (lost)
+        LogMessage(L"Watchdog: %ld further stall report(s) dropped while the log was busy", lost);
+}
+
+static BOOL ReadHeartbeat(HEARTBEAT *out)
+{
+    for (int attempt = 0; attempt < HEARTBEAT_READ_RETRIES; attempt++)
+    {
+        LONG before = InterlockedCompareExchange(&g.heartbeat.seq, 0, 0);
+        if (before & 1)
+            continue;
+        memcpy(out, (const void *)&g.heartbeat, sizeof(HEARTBEAT));
+        MemoryBarrier();
+        if (InterlockedCompareExchange(&g.heartbeat.seq, 0, 0) == before)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+// Watches the monitor thread's heartbeat. A phase that runs longer than WatchdogStallMs
+// is reported once, with the PID being worked on. The watchdog then asks the phase to
+// stop early and cancels any synchronous I/O the thread is blocked in (log rotation,
+// config reads). The decision stage is not abandoned; a single process it spends
+// WatchdogStallMs on is handed to NoteStalledDecision instead.
+DWORD WINAPI WatchdogThread(LPVOID lpParam)
+{
+    (void)lpParam;
+    LONG reportedSeq = 0;
+    LONG blamedSeq = 0, blamedPid = 0;
+    while (WaitForSingleObject(g.hStopEvent, WATCHDOG_POLL_MS) != WAIT_OBJECT_0)
+    {
+        EnterSharedLock(&g.csConfig);
+        DWORD stallMs = g.config.watchdogStallMs;
+        LeaveCriticalSection(&g.csConfig);
+        HEARTBEAT hb;
+        if (stallMs == 0 || !ReadHeartbeat(&hb) || hb.phase == PHASE_WAIT)
+            continue;
+        if (hb.phase == PHASE_DECIDE)
+        {
+            // pid is read before pidSince, which the monitor writes first, so a race only
+            // makes the time look shorter.
+            LONG pid = InterlockedCompareExchange(&g.heartbeat.pid, 0, 0);
+            ULONGLONG pidSince = (ULONGLONG)InterlockedCompareExchange64(&g.heartbeat.pidSince, 0, 0);
+            if (pid && !(pid == blamedPid && hb.seq == blamedSeq) && MonotonicMs() - pidSince >= stallMs)
+            {
+                blamedSeq = hb.seq;
+                blamedPid = pid;
+                InterlockedExchange(&g.stalledPid, pid);
+            }
+        }
+        if (hb.seq == reportedSeq)
+            continue;
+        ULONGLONG stalled = MonotonicMs() - hb.since;
+        if (stalled < stallMs)
+            continue;
+
+        reportedSeq = hb.seq;
+        InterlockedIncrement(&g.phaseStalls[hb.phase]);
+        BOOL abandonable = hb.phase == PHASE_WINDOWS || hb.phase == PHASE_MEASURE;
+        if (abandonable)
+        {
+            InterlockedExchange(&g.abandonSeq, hb.seq);
+            InterlockedIncrement(&g.abandonedStages);
+        }
+        CancelSynchronousIo(g.hMonitorThread);
+        // Reported last and without waiting: the stall may be inside the logger itself.
+        WCHAR text[256];
+        if (hb.pid)
+            swprintf(text, 256, L"Watchdog: monitor thread stalled in %ls for %llu ms (PID %ld)%ls", PHASE_NAMES[hb.phase],
+                     stalled, hb.pid, abandonable ? L", abandoning the phase" : L"");
+        else
+            swprintf(text, 256, L"Watchdog: monitor thread stalled in %ls for %llu ms%ls", PHASE_NAMES[hb.phase], stalled,
+                     abandonable ? L", abandoning the phase" : L"");
+        WatchdogReport(text);
+    }
+    return 0;
+}
+
+// Writes one line per phase with its latency histogram (only non-empty buckets).
+static void LogPhaseLatency(void)
+{
+    for (int i = 0; i < PHASE_COUNT; i++)
+    {
+        const PHASE_STATS *ps = &g.phaseStats[i];
+        if (i == PHASE_WAIT || ps->count == 0)
+            continue;
+        WCHAR line[1024];
+        int len = swprintf(line, 1024, L"Phase latency %ls: %lu samples, max %lu ms, %ld stalls;", PHASE_NAMES[i],
+                           ps->count, ps->maxMs, g.phaseStalls[i]);
+        for (int b = 0; b < LATENCY_BUCKETS && len > 0; b++)
+        {
+            if (ps->buckets[b] == 0)
+                continue;
+            int n;
+            if (b == 0)
+                n = swprintf(line + len, 1024 - len, L" <1ms:%lu", ps->buckets[b]);
+            else if (b == LATENCY_BUCKETS - 1)
+                n = swprintf(line + len, 1024 - len, L" >=%lums:%lu", 1ul << (b - 1), ps->buckets[b]);
+            else
+                n = swprintf(line + len, 1024 - len, L" %lu-%lums:%lu", 1ul << (b - 1), 1ul << b, ps->buckets[b]);
+            if (n < 0)
+                break;
+            len += n;
+        }
+        LogMessage(L"%ls", line);
+    }
+}
+
+// -------------------- System Pressure --------------------
+static ULONGLONG FileTimeToUll(const FILETIME *ft)
+{
+    ULARGE_INTEGER v;
+    v.LowPart = ft->dwLowDateTime;
+    v.HighPart = ft->dwHighDateTime;
+    return v.QuadPart;
+}
+
+// Samples total CPU, memory load and commit charge and decides whether CPU/memory
+// enforcement is armed for this scan. Always armed when PressureGating is off.
+static BOOL EvaluateSystemPressure(const CONFIG *cfg)
+{
+    SYSTEM_PRESSURE *p = &g.pressure;
+    if (!cfg->pressureGating && !cfg->victimSelection && !cfg->adaptiveInterval)
+    {
+        p->armed = TRUE;
+        return TRUE;
+    }
+
+    FILETIME ftIdle, ftKernel, ftUser;
+    if (GetSystemTimes(&ftIdle, &ftKernel, &ftUser))
+    {
+        ULONGLONG idle = FileTimeToUll(&ftIdle);
+        ULONGLONG kernel = FileTimeToUll(&ftKernel); // includes idle time
+        ULONGLONG user = FileTimeToUll(&ftUser);
+        ULONGLONG total = (kernel - p->prevKernel) + (user - p->prevUser);
+        if (p->prevKernel != 0 && total > 0)
+            p->cpuPercent = (DWORD)((total - (idle - p->prevIdle)) * 100 / total);
+        p->prevIdle = idle;
+        p->prevKernel = kernel;
+        p->prevUser = user;
+    }
+
+    MEMORYSTATUSEX ms;
+    ms.dwLength = sizeof(ms);
+    if (GlobalMemoryStatusEx(&ms))
+    {
+        p->memoryPercent = ms.dwMemoryLoad;
+        p->totalPhysMb = ms.ullTotalPhys / (1024 * 1024);
+        if (ms.ullTotalPageFile > 0)
+            p->commitPercent = (DWORD)((ms.ullTotalPageFile - ms.ullAvailPageFile) * 100 / ms.ullTotalPageFile);
+    }
+
+    p->memoryStressed = p->memoryPercent >= cfg->pressureMemoryPercent ||
+                        p->commitPercent >= cfg->pressureCommitPercent;
+    if (!cfg->pressureGating)
+    {
+        p->armed = TRUE;
+        return TRUE;
+    }
+
+    ULONGLONG now = GetTickCount64();
+    BOOL stressed = p->cpuPercent >= cfg->pressureCpuPercent || p->memoryStressed;
+    if (stressed)
+        p->lastStressedTick = now;
+
+    BOOL armed = stressed || (p->lastStressedTick != 0 && now - p->lastStressedTick < PRESSURE_HOLD_MS);
+    if (armed != p->armed)
+    {
+        LogMessage(L"Enforcement %ls: system CPU %lu%%, memory %lu%%, commit %lu%%",
+                   armed ? L"armed" : L"disarmed (system not under pressure)",
+                   p->cpuPercent, p->memoryPercent, p->commitPercent);
+        p->armed = armed;
+    }
+    return armed;
+}
+
 static void ProcessSnapshot(const CONFIG *localConfig)
 {
+    // Counted from here so the hung window list is included.
+    g.scanHeapAllocs = 0;
+    EnterPhase(PHASE_LOG);
     RotateLogIfNeeded(localConfig->logMaxSizeBytes);
 
+    EnterPhase(PHASE_WINDOWS);
     HUNG_PROCESS_NODE *hungList = BuildHungProcessList(localConfig->hangTimeoutMs, localConfig->maxHungWindows, g.hStopEvent);
 
+    EnterPhase(PHASE_SNAPSHOT);
     HANDLE hSnapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
     if (hSnapshot == INVALID_HANDLE_VALUE)
     {
@@ -1907,7 +5442,8 @@ static void ProcessSnapshot(const CONFIG *localConfig)
         if (wait > MAX_BACKOFF_WAIT_MS)
             wait = MAX_BACKOFF_WAIT_MS;
 
-        FreeHungProcessList(hungList);
+        ArenaReset(&g.scanArena);
+        EnterPhase(PHASE_WAIT);
         DWORD step = 200;
         for (DWORD elapsed = 0; elapsed < wait; elapsed += step)
         {
@@ -1927,61 +5463,380 @@ static void ProcessSnapshot(const CONFIG *localConfig)
         }
     }
 
-    EnterCriticalSection(&g.csHistory);
-    for (PROCESS_HISTORY *h = g.history; h != NULL; h = h->next)
-    {
-        h->seen = FALSE;
-    }
-    LeaveCriticalSection(&g.csHistory);
+    ProcessActionResults();
+    BOOL armed = EvaluateSystemPressure(localConfig);
+    BeginBreakerScan(localConfig);
+
+    // `seen` was cleared on surviving records by the previous CleanupHistory, so no pass
+    // over the history is needed here.
+    ULONGLONG scanStart = GetTickCount64();
+    g.scanLookups = 0;
+    g.scanLockWaits = 0;
+    g.scanNearLimit = 0;
+    g.scanApproaching = 0;
+    g.scanMeasured = FALSE;
+    g.scanTiered = FALSE;
+    memset(g.scanSampled, 0, sizeof(g.scanSampled));
+    g.scanDeferred = 0;
 
     PROCESSENTRY32W pe;
     pe.dwSize = sizeof(PROCESSENTRY32W);
     if (!Process32FirstW(hSnapshot, &pe))
     {
         CloseHandle(hSnapshot);
-        FreeHungProcessList(hungList);
+        ArenaReset(&g.scanArena);
         return;
     }
 
+    // Collect the whole snapshot first so tree totals can be computed after all
+    // processes have been measured.
+    g.scanCount = 0;
     do
     {
-        CheckProcess(&pe, localConfig, hungList);
+        if (!EnsureScanCapacity(g.scanCount + 1))
+        {
+            // Out of memory: fall back to checking the process on its own.
+            if (armed || IsProcessHung(pe.th32ProcessID, NULL, hungList))
+            {
+                PROCESS_SAMPLE sample;
+                MeasureProcess(&pe, localConfig, &sample, NO_SCAN_SLOT, &g.scanWorkerState[MONITOR_SCAN_WORKER]);
+                PublishSampleHistory(&sample);
+                CheckProcess(&pe, &sample, localConfig, hungList, NULL);
+            }
+            continue;
+        }
+        SCAN_ENTRY *entry = &g.scan[g.scanCount++];
+        memset(entry, 0, sizeof(SCAN_ENTRY));
+        entry->pe = pe;
+        entry->parentIndex = -1;
     } while (Process32NextW(hSnapshot, &pe));
 
     CloseHandle(hSnapshot);
-    FreeHungProcessList(hungList);
+
+    if (!armed)
+    {
+        // Quiet machine: only hung windows are enforced, and per-process measurement is
+        // skipped. History is kept so trends resume when pressure returns; the first CPU
+        // sample after re-arming averages over the quiet period.
+        // Records of processes still in the snapshot are kept and the rest are dropped,
+        // including ones that never got a handle, so exited processes do not pin handles
+        // or PIDs.
+        EnterPhase(PHASE_DECIDE);
+        ULONGLONG decideTick = GetTickCount64();
+        for (DWORD i = 0; i < g.scanCount; i++)
+        {
+            PROCESS_HISTORY *hist = LookupHistory(g.scan[i].pe.th32ProcessID);
+            if (hist)
+            {
+                hist->seen = TRUE;
+                if (hist->decideSkipUntil > decideTick)
+                    continue;
+            }
+            EnterDecision(g.scan[i].pe.th32ProcessID);
+            if (IsProcessHung(g.scan[i].pe.th32ProcessID, NULL, hungList))
+            {
+                MeasureProcess(&g.scan[i].pe, localConfig, &g.scan[i].sample, NO_SCAN_SLOT,
+                               &g.scanWorkerState[MONITOR_SCAN_WORKER]);
+                PublishSampleHistory(&g.scan[i].sample);
+                CheckProcess(&g.scan[i].pe, &g.scan[i].sample, localConfig, hungList, &g.scan[i]);
+            }
+            if (g.stalledPid)
+                NoteStalledDecision();
+        }
+        g.heartbeat.pid = 0;
+        EnterPhase(PHASE_CLEANUP);
+        EndBreakerScan();
+        ArenaReset(&g.scanArena);
+        CleanupHistory();
+        PublishScanStatus((DWORD)(GetTickCount64() - scanStart));
+        return;
+    }
+
+    EnterPhase(PHASE_MEASURE);
+    PlanScanSampling(localConfig, hungList);
+    if (!MeasureScan(localConfig))
+    {
+        // Stopping; workers may still hold samples, Cleanup frees unlinked records.
+        ArenaReset(&g.scanArena);
+        return;
+    }
+    FinishScanSampling();
+    g.scanNearLimit = ComputeScanUsage(localConfig);
+    for (DWORD i = 0; i < g.scanCount; i++)
+    {
+        PublishSampleHistory(&g.scan[i].sample);
+    }
+    EnterPhase(PHASE_DECIDE);
+    ULONGLONG decideTick = GetTickCount64();
+    for (DWORD i = 0; i < g.scanCount; i++)
+    {
+        const PROCESS_HISTORY *hist = g.scan[i].sample.hist;
+        if (hist && hist->decideSkipUntil > decideTick)
+            continue;
+        EnterDecision(g.scan[i].pe.th32ProcessID);
+        CheckProcess(&g.scan[i].pe, &g.scan[i].sample, localConfig, hungList, &g.scan[i]);
+        if (g.stalledPid)
+            NoteStalledDecision();
+    }
+    g.heartbeat.pid = 0;
+    if (g.stalledPid)
+        NoteStalledDecision();
+
+    if (localConfig->victimSelection)
+        SelectMemoryVictims(localConfig);
+
+    if (localConfig->treeAggregation)
+    {
+        AggregateProcessTree();
+        CheckProcessTrees(localConfig);
+    }
+
+    EnterPhase(PHASE_CLEANUP);
+    UpdateSampleTiers(localConfig);
+    EndBreakerScan();
+    ArenaReset(&g.scanArena);
     CleanupHistory();
+    PublishScanStatus((DWORD)(GetTickCount64() - scanStart));
 }
 
 // -------------------- Monitor Thread --------------------
+// Offset of the first tick within [0, staggerMs), derived from the computer name so each
+// machine of a fleet started at the same moment scans at its own, stable phase.
+static DWORD StartStaggerOffset(DWORD staggerMs)
+{
+    if (staggerMs == 0)
+        return 0;
+    WCHAR name[MAX_COMPUTERNAME_LENGTH + 1];
+    DWORD size = MAX_COMPUTERNAME_LENGTH + 1;
+    DWORD length;
+    DWORD hash = GetComputerNameW(name, &size) ? FoldedHash(name, &length) : GetCurrentProcessId();
+    return hash % staggerMs;
+}
+
+// Moves the deadline to the next tick on the fixed grid. When the scan ran past one or
+// more deadlines they are skipped or coalesced into one immediate tick; either way the
+// grid keeps its phase, so the CPU% windows stay one interval long.
+static ULONGLONG NextTickDeadline(ULONGLONG deadline, DWORD intervalMs, int overrunPolicy, DWORD scanMs)
+{
+    ULONGLONG now = MonotonicMs();
+    deadline += intervalMs;
+    if (now < deadline)
+        return deadline;
+
+    // Deadlines in [deadline, now] were missed.
+    DWORD missed = (DWORD)((now - deadline) / intervalMs) + 1;
+    g.sched.overruns++;
+    if (overrunPolicy == OVERRUN_COALESCE)
+    {
+        deadline += (ULONGLONG)(missed - 1) * intervalMs;
+        g.sched.skippedTicks += missed - 1;
+    }
+    else
+    {
+        deadline += (ULONGLONG)missed * intervalMs;
+        g.sched.skippedTicks += missed;
+    }
+    if (g.sched.lastOverrunLog == 0 || now - g.sched.lastOverrunLog >= OVERRUN_LOG_INTERVAL_MS)
+    {
+        g.sched.lastOverrunLog = now;
+        LogMessage(L"Scan took %lu ms, longer than MonitorIntervalMs (%lu ms); %lu tick(s) %ls (%lu overruns so far)",
+                   scanMs, intervalMs, missed, overrunPolicy == OVERRUN_COALESCE ? L"coalesced" : L"skipped",
+                   g.sched.overruns);
+    }
+    return deadline;
+}
+
+// Chooses the interval to the next deadline. With AdaptiveInterval it is halved while a
+// normal process is close to a threshold or the system is under pressure, grows by a
+// quarter while the machine is idle, and otherwise returns halfway to MonitorIntervalMs.
+// A scan that measured nothing (disarmed) never counts as idle. The range always
+// includes MonitorIntervalMs.
+static void AdaptInterval(const CONFIG *cfg, BOOL scanned)
+{
+    DWORD base = cfg->monitorIntervalMs;
+    DWORD current = g.sched.intervalMs ? g.sched.intervalMs : base;
+    if (!cfg->adaptiveInterval)
+    {
+        g.sched.intervalMs = base;
+        return;
+    }
+    if (!scanned)
+        return; // monitoring is off, nothing new to go by
+
+    DWORD lo = cfg->adaptiveMinIntervalMs < base ? cfg->adaptiveMinIntervalMs : base;
+    DWORD hi = cfg->adaptiveMaxIntervalMs > base ? cfg->adaptiveMaxIntervalMs : base;
+    const SYSTEM_PRESSURE *p = &g.pressure;
+    BOOL stressed = p->cpuPercent >= cfg->pressureCpuPercent || p->memoryStressed;
+    BOOL urgent = g.scanApproaching > 0 || stressed;
+    BOOL idle = !urgent && g.scanMeasured && p->cpuPercent < cfg->pressureCpuPercent / 2;
+
+    DWORD next;
+    if (urgent)
+        next = current / 2;
+    else if (idle)
+        next = current + current / 4;
+    else
+        next = current > base ? current - (current - base) / 2 : current + (base - current) / 2;
+    if (next < lo)
+        next = lo;
+    if (next > hi)
+        next = hi;
+
+    if (next < current)
+        g.sched.shortened++;
+    else if (next > current)
+        g.sched.lengthened++;
+    g.sched.intervalMs = next;
+}
+
+// Tracks the CPU time of the whole monitor process (scan, workers, executor and UI) per
+// tick and per hour of wall time, averaged over recent ticks, and its working set.
+static void UpdateSelfCost(ULONGLONG now)
+{
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+        g.sched.selfMemMB = (DWORD)(pmc.WorkingSetSize / (1024 * 1024));
+
+    FILETIME ftCreate, ftExit, ftKernel, ftUser;
+    if (!GetProcessTimes(GetCurrentProcess(), &ftCreate, &ftExit, &ftKernel, &ftUser))
+        return;
+    ULONGLONG cpu = FileTimeToUll(&ftKernel) + FileTimeToUll(&ftUser);
+    if (g.sched.selfCpuStamp != 0 && now > g.sched.selfCpuStamp)
+    {
+        g.sched.tickCpuMs = (DWORD)((cpu - g.sched.selfCpuPrev) / 10000);
+        if (g.sched.tickCpuMs > g.sched.tickCpuMaxMs)
+            g.sched.tickCpuMaxMs = g.sched.tickCpuMs;
+        // 100 ns units -> ms of CPU per hour of wall time
+        ULONGLONG rate = (cpu - g.sched.selfCpuPrev) * 360 / (now - g.sched.selfCpuStamp);
+        if (rate > MAXDWORD)
+            rate = MAXDWORD;
+        LONGLONG delta = (LONGLONG)rate - (LONGLONG)g.sched.cpuMsPerHour;
+        g.sched.cpuMsPerHour = (DWORD)((LONGLONG)g.sched.cpuMsPerHour + delta / (1 << SELF_COST_EWMA_SHIFT));
+    }
+    g.sched.selfCpuPrev = cpu;
+    g.sched.selfCpuStamp = now;
+}
+
+// Compares the monitor's own cost with SelfCpuBudgetPercent and SelfMemoryBudgetMb. Over
+// budget the governor goes up a level, and it comes back down once the CPU cost is
+// below half the budget and the working set below 90% of it. A level is held for as
+// many ticks as the CPU average spans, so each step is judged on its own effect.
+static void GovernSelf(const CONFIG *cfg)
+{
+    SELF_GOVERNOR *gov = &g.governor;
+    gov->ticksAtLevel++;
+    if (gov->level)
+        gov->governedTicks++;
+
+    ULONGLONG cpuBudget = (ULONGLONG)cfg->selfCpuBudgetPercent * 36000; // ms per hour
+    ULONGLONG memBudget = cfg->selfMemoryBudgetMb;
+    BOOL over = (cpuBudget && g.sched.cpuMsPerHour > cpuBudget) || (memBudget && g.sched.selfMemMB > memBudget);
+    BOOL under = (!cpuBudget || g.sched.cpuMsPerHour * 2 <= cpuBudget) &&
+                 (!memBudget || (ULONGLONG)g.sched.selfMemMB * 10 <= memBudget * 9);
+    if (gov->ticksAtLevel < (1u << SELF_COST_EWMA_SHIFT))
+        return;
+
+    DWORD level = gov->level;
+    if (over && level < MAX_GOVERNOR_LEVEL)
+        level++;
+    else if (under && level > 0)
+        level--;
+    if (level == gov->level)
+        return;
+
+    if (level > gov->level)
+    {
+        LogMessage(L"Monitor over its self-budget (CPU %lu ms per hour, %lu MB): scan interval x%lu",
+                   g.sched.cpuMsPerHour, g.sched.selfMemMB, 1ul << level);
+        if (gov->level == 0)
+        {
+            LogMessage(L"Self-budget: status details (tracked count, highest CPU and memory) no longer refreshed");
+            LogMessage(L"Self-budget: hourly phase latency log paused");
+        }
+    }
+    else if (level == 0)
+    {
+        LogMessage(L"Monitor back within its self-budget (CPU %lu ms per hour, %lu MB): status details and phase latency log resumed",
+                   g.sched.cpuMsPerHour, g.sched.selfMemMB);
+    }
+    gov->level = level;
+    gov->ticksAtLevel = 0;
+}
+
+// Ticks fire on a fixed cadence measured from the first deadline, not interval + scan
+// time, so the period does not stretch with load. The cadence is MonitorIntervalMs, or
+// the adaptive interval (see AdaptInterval), widened by the self-budget governor.
 DWORD WINAPI MonitorThread(LPVOID lpParam)
 {
     ULONGLONG lastConfigCheck = 0;
     ULONGLONG lastConfigFailBalloon = 0;
 
+    EnterSharedLock(&g.csConfig);
+    DWORD staggerMs = g.config.startStaggerMs;
+    LeaveCriticalSection(&g.csConfig);
+    DWORD offset = StartStaggerOffset(staggerMs);
+    if (offset)
+        LogMessage(L"First scan staggered by %lu ms", offset);
+    ULONGLONG deadline = MonotonicMs() + offset;
+    ULONGLONG lastLatencyReport = deadline;
+
     while (InterlockedCompareExchange(&g.programRunning, 1, 1) == 1)
     {
+        // The wait may wake up slightly early; only run once the deadline has passed.
+        EnterPhase(PHASE_WAIT);
+        ULONGLONG now = MonotonicMs();
+        while (now < deadline)
+        {
+            if (WaitForSingleObject(g.hStopEvent, (DWORD)(deadline - now)) == WAIT_OBJECT_0)
+                return 0;
+            now = MonotonicMs();
+        }
+
+        EnterPhase(PHASE_HOUSEKEEPING);
+        FlushWatchdogReport();
         HandleConfigReload(&lastConfigCheck, &lastConfigFailBalloon);
 
         if (InterlockedCompareExchange(&g.systemResumed, 1, 1) == 1)
         {
             ResetAllHistory();
             InterlockedExchange(&g.systemResumed, 0);
+            // Time asleep is not lateness; restart the grid from now.
+            deadline = now;
         }
 
+        DWORD late = (DWORD)(now - deadline);
+        g.sched.ticks++;
+        g.sched.lateSumMs += late;
+        if (late > g.sched.lateMaxMs)
+            g.sched.lateMaxMs = late;
+
         PeriodicBalloonCleanup();
 
         CONFIG localConfig;
-        EnterCriticalSection(&g.csConfig);
+        EnterSharedLock(&g.csConfig);
         localConfig = g.config;
         LeaveCriticalSection(&g.csConfig);
 
-        if (InterlockedCompareExchange(&g.monitorActive, 0, 0) == 1)
+        BOOL scanned = InterlockedCompareExchange(&g.monitorActive, 0, 0) == 1;
+        if (scanned)
         {
             ProcessSnapshot(&localConfig);
         }
 
-        WaitForSingleObject(g.hStopEvent, localConfig.monitorIntervalMs);
+        EnterPhase(PHASE_WAIT);
+        ULONGLONG done = MonotonicMs();
+        if (!g.governor.level && done - lastLatencyReport >= LATENCY_REPORT_INTERVAL_MS)
+        {
+            LogPhaseLatency();
+            lastLatencyReport = done;
+        }
+        UpdateSelfCost(done);
+        AdaptInterval(&localConfig, scanned);
+        GovernSelf(&localConfig);
+        DWORD interval = g.sched.intervalMs << g.governor.level;
+        if (interval > MAX_ADAPTIVE_INTERVAL_MS)
+            interval = MAX_ADAPTIVE_INTERVAL_MS;
+        deadline = NextTickDeadline(deadline, interval, localConfig.overrunPolicy, (DWORD)(done - now));
     }
     return 0;
 }
@@ -2095,6 +5950,23 @@ static void SplitExcludeString(const WCHAR *input, WCHAR excludeList[MAX_EXCLUDE
     }
 }
 
+// Reads a keyword setting (e.g. CpuAction=terminate) and returns its index in names.
+static int ParseNamedValue(const WCHAR *configPath, const WCHAR *key, const WCHAR *const *names, int count, int defaultValue)
+{
+    WCHAR buf[64];
+    GetPrivateProfileStringW(L"Settings", key, names[defaultValue], buf, 64, configPath);
+    WCHAR *name = TrimWhitespace(buf);
+    if (name[0] == L'\0')
+        return defaultValue;
+    for (int i = 0; i < count; i++)
+    {
+        if (_wcsicmp(name, names[i]) == 0)
+            return i;
+    }
+    LogMessage(L"Warning: Unknown %ls value '%ls'; using '%ls'.", key, name, names[defaultValue]);
+    return defaultValue;
+}
+
 BOOL LoadConfig(void)
 {
     WCHAR configPath[MAX_LONG_PATH];
@@ -2116,6 +5988,64 @@ BOOL LoadConfig(void)
     newConfig.maxHungWindows = GetPrivateProfileIntW(L"Settings", L"MaxHungWindows", DEFAULT_MAX_HUNG_WINDOWS, configPath);
     newConfig.notifyOnTermination = GetPrivateProfileIntW(L"Settings", L"NotifyOnTermination", DEFAULT_NOTIFY_ON_TERMINATION, configPath) != 0;
     newConfig.monitoringDefault = GetPrivateProfileIntW(L"Settings", L"StartMonitoringOnLaunch", 1, configPath) != 0;
+    newConfig.ruleAction[RULE_CPU] = ParseNamedValue(configPath, L"CpuAction", ACTION_NAMES, ACTION_COUNT, ACTION_TERMINATE);
+    newConfig.ruleAction[RULE_MEM] = ParseNamedValue(configPath, L"MemAction", ACTION_NAMES, ACTION_COUNT, ACTION_TERMINATE);
+    newConfig.ruleAction[RULE_HANG] = ACTION_TERMINATE; // throttling does not help a hung window
+    newConfig.ruleGraceSec[RULE_CPU] = GetPrivateProfileIntW(L"Settings", L"CpuGraceSec", DEFAULT_CPU_GRACE_SEC, configPath);
+    newConfig.ruleGraceSec[RULE_MEM] = GetPrivateProfileIntW(L"Settings", L"MemGraceSec", DEFAULT_MEM_GRACE_SEC, configPath);
+    newConfig.ruleGraceSec[RULE_HANG] = GetPrivateProfileIntW(L"Settings", L"HangGraceSec", DEFAULT_HANG_GRACE_SEC, configPath);
+    newConfig.hysteresisExitPercent = GetPrivateProfileIntW(L"Settings", L"HysteresisExitPercent", DEFAULT_HYSTERESIS_EXIT_PERCENT, configPath);
+    newConfig.violationDwellMs = GetPrivateProfileIntW(L"Settings", L"ViolationDwellMs", DEFAULT_VIOLATION_DWELL_MS, configPath);
+    newConfig.recoveryDwellMs = GetPrivateProfileIntW(L"Settings", L"RecoveryDwellMs", DEFAULT_RECOVERY_DWELL_MS, configPath);
+    newConfig.killRatePerMinute = GetPrivateProfileIntW(L"Settings", L"KillRatePerMinute", DEFAULT_KILL_RATE_PER_MINUTE, configPath);
+    newConfig.ruleKillRatePerMinute[RULE_CPU] = GetPrivateProfileIntW(L"Settings", L"CpuKillRatePerMinute", DEFAULT_RULE_KILL_RATE_PER_MINUTE, configPath);
+    newConfig.ruleKillRatePerMinute[RULE_MEM] = GetPrivateProfileIntW(L"Settings", L"MemKillRatePerMinute", DEFAULT_RULE_KILL_RATE_PER_MINUTE, configPath);
+    newConfig.ruleKillRatePerMinute[RULE_HANG] = GetPrivateProfileIntW(L"Settings", L"HangKillRatePerMinute", DEFAULT_RULE_KILL_RATE_PER_MINUTE, configPath);
+    newConfig.stormThreshold = GetPrivateProfileIntW(L"Settings", L"StormThreshold", DEFAULT_STORM_THRESHOLD, configPath);
+    newConfig.ruleCloseTimeoutMs[RULE_CPU] = GetPrivateProfileIntW(L"Settings", L"CpuCloseTimeoutMs", DEFAULT_CPU_CLOSE_TIMEOUT_MS, configPath);
+    newConfig.ruleCloseTimeoutMs[RULE_MEM] = GetPrivateProfileIntW(L"Settings", L"MemCloseTimeoutMs", DEFAULT_MEM_CLOSE_TIMEOUT_MS, configPath);
+    newConfig.ruleCloseTimeoutMs[RULE_HANG] = GetPrivateProfileIntW(L"Settings", L"HangCloseTimeoutMs", DEFAULT_HANG_CLOSE_TIMEOUT_MS, configPath);
+    newConfig.ageRampSec = GetPrivateProfileIntW(L"Settings", L"AgeRampSec", DEFAULT_AGE_RAMP_SEC, configPath);
+    newConfig.ageThresholdScalePercent = GetPrivateProfileIntW(L"Settings", L"AgeThresholdScalePercent", DEFAULT_AGE_THRESHOLD_SCALE_PERCENT, configPath);
+    newConfig.throttleAffinityCores = GetPrivateProfileIntW(L"Settings", L"ThrottleAffinityCores", DEFAULT_THROTTLE_AFFINITY_CORES, configPath);
+    newConfig.cpuRateCapPercent = GetPrivateProfileIntW(L"Settings", L"CpuRateCapPercent", DEFAULT_CPU_RATE_CAP_PERCENT, configPath);
+    newConfig.throttleIdlePriority = GetPrivateProfileIntW(L"Settings", L"ThrottleIdlePriority", DEFAULT_THROTTLE_IDLE_PRIORITY, configPath) != 0;
+    newConfig.memCapCommitLimitMb = GetPrivateProfileIntW(L"Settings", L"MemCapCommitLimitMb", DEFAULT_MEM_CAP_COMMIT_LIMIT_MB, configPath);
+    newConfig.memCapEscalateMs = GetPrivateProfileIntW(L"Settings", L"MemCapEscalateMs", DEFAULT_MEM_CAP_ESCALATE_MS, configPath);
+    newConfig.memMetric = ParseNamedValue(configPath, L"MemMetric", MEM_METRIC_NAMES, MEM_METRIC_COUNT, MEM_METRIC_WORKING_SET);
+    newConfig.cpuNormalization = ParseNamedValue(configPath, L"CpuNormalization", CPU_NORM_NAMES, CPU_NORM_COUNT, CPU_NORM_CORE);
+    newConfig.cpuSaturationPercent = GetPrivateProfileIntW(L"Settings", L"CpuSaturationPercent", DEFAULT_CPU_SATURATION_PERCENT, configPath);
+    newConfig.pressureGating = GetPrivateProfileIntW(L"Settings", L"PressureGating", DEFAULT_PRESSURE_GATING, configPath) != 0;
+    newConfig.pressureCpuPercent = GetPrivateProfileIntW(L"Settings", L"PressureCpuPercent", DEFAULT_PRESSURE_CPU_PERCENT, configPath);
+    newConfig.pressureMemoryPercent = GetPrivateProfileIntW(L"Settings", L"PressureMemoryPercent", DEFAULT_PRESSURE_MEMORY_PERCENT, configPath);
+    newConfig.pressureCommitPercent = GetPrivateProfileIntW(L"Settings", L"PressureCommitPercent", DEFAULT_PRESSURE_COMMIT_PERCENT, configPath);
+    newConfig.victimSelection = GetPrivateProfileIntW(L"Settings", L"VictimSelection", DEFAULT_VICTIM_SELECTION, configPath) != 0;
+    newConfig.victimMaxPerScan = GetPrivateProfileIntW(L"Settings", L"VictimMaxPerScan", DEFAULT_VICTIM_MAX_PER_SCAN, configPath);
+    newConfig.leakDetection = GetPrivateProfileIntW(L"Settings", L"LeakDetection", DEFAULT_LEAK_DETECTION, configPath);
+    newConfig.leakHorizonSec = GetPrivateProfileIntW(L"Settings", L"LeakHorizonSec", DEFAULT_LEAK_HORIZON_SEC, configPath);
+    newConfig.leakMinSamples = GetPrivateProfileIntW(L"Settings", L"LeakMinSamples", DEFAULT_LEAK_MIN_SAMPLES, configPath);
+    newConfig.leakMinGrowthMbPerMin = GetPrivateProfileIntW(L"Settings", L"LeakMinGrowthMbPerMin", DEFAULT_LEAK_MIN_GROWTH_MB_PER_MIN, configPath);
+    newConfig.treeAggregation = GetPrivateProfileIntW(L"Settings", L"TreeAggregation", DEFAULT_TREE_AGGREGATION, configPath) != 0;
+    newConfig.treeCpuThresholdPercent = GetPrivateProfileIntW(L"Settings", L"TreeCpuThresholdPercent", DEFAULT_TREE_CPU_THRESHOLD_PERCENT, configPath);
+    newConfig.treeMemThresholdMb = GetPrivateProfileIntW(L"Settings", L"TreeMemThresholdMb", DEFAULT_TREE_MEM_THRESHOLD_MB, configPath);
+    newConfig.scanWorkers = GetPrivateProfileIntW(L"Settings", L"ScanWorkers", DEFAULT_SCAN_WORKERS, configPath);
+    newConfig.overrunPolicy = ParseNamedValue(configPath, L"OverrunPolicy", OVERRUN_NAMES, OVERRUN_COUNT, OVERRUN_SKIP);
+    newConfig.startStaggerMs = GetPrivateProfileIntW(L"Settings", L"StartStaggerMs", DEFAULT_START_STAGGER_MS, configPath);
+    newConfig.adaptiveInterval = GetPrivateProfileIntW(L"Settings", L"AdaptiveInterval", DEFAULT_ADAPTIVE_INTERVAL, configPath) != 0;
+    newConfig.adaptiveMinIntervalMs = GetPrivateProfileIntW(L"Settings", L"AdaptiveMinIntervalMs", DEFAULT_ADAPTIVE_MIN_INTERVAL_MS, configPath);
+    newConfig.adaptiveMaxIntervalMs = GetPrivateProfileIntW(L"Settings", L"AdaptiveMaxIntervalMs", DEFAULT_ADAPTIVE_MAX_INTERVAL_MS, configPath);
+    newConfig.adaptiveNearPercent = GetPrivateProfileIntW(L"Settings", L"AdaptiveNearPercent", DEFAULT_ADAPTIVE_NEAR_PERCENT, configPath);
+    newConfig.tieredSampling = GetPrivateProfileIntW(L"Settings", L"TieredSampling", DEFAULT_TIERED_SAMPLING, configPath) != 0;
+    newConfig.tierHotPercent = GetPrivateProfileIntW(L"Settings", L"TierHotPercent", DEFAULT_TIER_HOT_PERCENT, configPath);
+    newConfig.tierWarmPercent = GetPrivateProfileIntW(L"Settings", L"TierWarmPercent", DEFAULT_TIER_WARM_PERCENT, configPath);
+    newConfig.tierWarmEvery = GetPrivateProfileIntW(L"Settings", L"TierWarmEvery", DEFAULT_TIER_WARM_EVERY, configPath);
+    newConfig.tierColdBatch = GetPrivateProfileIntW(L"Settings", L"TierColdBatch", DEFAULT_TIER_COLD_BATCH, configPath);
+    newConfig.scanBudgetProcesses = GetPrivateProfileIntW(L"Settings", L"ScanBudgetProcesses", DEFAULT_SCAN_BUDGET_PROCESSES, configPath);
+    newConfig.scanBudgetUs = GetPrivateProfileIntW(L"Settings", L"ScanBudgetUs", DEFAULT_SCAN_BUDGET_US, configPath);
+    newConfig.backgroundMode = GetPrivateProfileIntW(L"Settings", L"BackgroundMode", DEFAULT_BACKGROUND_MODE, configPath) != 0;
+    newConfig.selfCpuBudgetPercent = GetPrivateProfileIntW(L"Settings", L"SelfCpuBudgetPercent", DEFAULT_SELF_CPU_BUDGET_PERCENT, configPath);
+    newConfig.selfMemoryBudgetMb = GetPrivateProfileIntW(L"Settings", L"SelfMemoryBudgetMb", DEFAULT_SELF_MEMORY_BUDGET_MB, configPath);
+    newConfig.watchdogStallMs = GetPrivateProfileIntW(L"Settings", L"WatchdogStallMs", DEFAULT_WATCHDOG_STALL_MS, configPath);
 
     BOOL clamped = FALSE;
     ULONGLONG now = GetTickCount64();
@@ -2138,13 +6068,70 @@ BOOL LoadConfig(void)
             LogMessage(L"Config " name L" adjusted from %u to %u (range %u-%u)", orig, newConfig.field, min, max); \
         }                                                                                                          \
     }
+    // Keys whose minimum is 0 only need the upper bound; an unsigned "< 0" test is always false
+#define CLAMP_MAX(field, max, name)                                                                           \
+    {                                                                                                         \
+        DWORD orig = newConfig.field;                                                                         \
+        if (newConfig.field > max)                                                                            \
+        {                                                                                                     \
+            newConfig.field = max;                                                                            \
+            clamped = TRUE;                                                                                   \
+            LogMessage(L"Config " name L" adjusted from %u to %u (range 0-%u)", orig, newConfig.field, max); \
+        }                                                                                                     \
+    }
     CLAMP(monitorIntervalMs, MIN_MONITOR_INTERVAL_MS, MAX_MONITOR_INTERVAL_MS, L"MonitorIntervalMs");
     CLAMP(cpuThresholdPercent, MIN_CPU_THRESHOLD, MAX_CPU_THRESHOLD, L"CpuThresholdPercent");
     CLAMP(memThresholdMb, MIN_MEM_THRESHOLD_MB, MAX_MEM_THRESHOLD_MB, L"MemThresholdMb");
     CLAMP(hangTimeoutMs, MIN_HANG_TIMEOUT_MS, MAX_HANG_TIMEOUT_MS, L"HangTimeoutMs");
     CLAMP(logMaxSizeBytes, MIN_LOG_SIZE_BYTES, MAX_LOG_SIZE_BYTES, L"LogMaxSizeBytes");
     CLAMP(maxHungWindows, MIN_MAX_HUNG_WINDOWS, MAX_MAX_HUNG_WINDOWS, L"MaxHungWindows");
+    CLAMP(throttleAffinityCores, MIN_THROTTLE_AFFINITY_CORES, MAX_THROTTLE_AFFINITY_CORES, L"ThrottleAffinityCores");
+    CLAMP(cpuRateCapPercent, MIN_CPU_RATE_CAP_PERCENT, MAX_CPU_RATE_CAP_PERCENT, L"CpuRateCapPercent");
+    CLAMP_MAX(memCapCommitLimitMb, MAX_MEM_CAP_COMMIT_LIMIT_MB, L"MemCapCommitLimitMb");
+    CLAMP(memCapEscalateMs, MIN_MEM_CAP_ESCALATE_MS, MAX_MEM_CAP_ESCALATE_MS, L"MemCapEscalateMs");
+    CLAMP_MAX(ruleGraceSec[RULE_CPU], MAX_GRACE_SEC, L"CpuGraceSec");
+    CLAMP_MAX(ruleGraceSec[RULE_MEM], MAX_GRACE_SEC, L"MemGraceSec");
+    CLAMP_MAX(ruleGraceSec[RULE_HANG], MAX_GRACE_SEC, L"HangGraceSec");
+    CLAMP(hysteresisExitPercent, MIN_HYSTERESIS_EXIT_PERCENT, MAX_HYSTERESIS_EXIT_PERCENT, L"HysteresisExitPercent");
+    CLAMP_MAX(violationDwellMs, MAX_VIOLATION_DWELL_MS, L"ViolationDwellMs");
+    CLAMP_MAX(recoveryDwellMs, MAX_RECOVERY_DWELL_MS, L"RecoveryDwellMs");
+    CLAMP_MAX(killRatePerMinute, MAX_KILL_RATE_PER_MINUTE, L"KillRatePerMinute");
+    CLAMP_MAX(ruleKillRatePerMinute[RULE_CPU], MAX_KILL_RATE_PER_MINUTE, L"CpuKillRatePerMinute");
+    CLAMP_MAX(ruleKillRatePerMinute[RULE_MEM], MAX_KILL_RATE_PER_MINUTE, L"MemKillRatePerMinute");
+    CLAMP_MAX(ruleKillRatePerMinute[RULE_HANG], MAX_KILL_RATE_PER_MINUTE, L"HangKillRatePerMinute");
+    CLAMP_MAX(stormThreshold, MAX_STORM_THRESHOLD, L"StormThreshold");
+    CLAMP_MAX(ruleCloseTimeoutMs[RULE_CPU], MAX_CLOSE_TIMEOUT_MS, L"CpuCloseTimeoutMs");
+    CLAMP_MAX(ruleCloseTimeoutMs[RULE_MEM], MAX_CLOSE_TIMEOUT_MS, L"MemCloseTimeoutMs");
+    CLAMP_MAX(ruleCloseTimeoutMs[RULE_HANG], MAX_CLOSE_TIMEOUT_MS, L"HangCloseTimeoutMs");
+    CLAMP_MAX(ageRampSec, MAX_AGE_RAMP_SEC, L"AgeRampSec");
+    CLAMP(ageThresholdScalePercent, MIN_AGE_THRESHOLD_SCALE_PERCENT, MAX_AGE_THRESHOLD_SCALE_PERCENT, L"AgeThresholdScalePercent");
+    CLAMP_MAX(cpuSaturationPercent, MAX_CPU_SATURATION_PERCENT, L"CpuSaturationPercent");
+    CLAMP(pressureCpuPercent, MIN_PRESSURE_PERCENT, MAX_PRESSURE_PERCENT, L"PressureCpuPercent");
+    CLAMP(pressureMemoryPercent, MIN_PRESSURE_PERCENT, MAX_PRESSURE_PERCENT, L"PressureMemoryPercent");
+    CLAMP(pressureCommitPercent, MIN_PRESSURE_PERCENT, MAX_PRESSURE_PERCENT, L"PressureCommitPercent");
+    CLAMP(victimMaxPerScan, MIN_VICTIM_MAX_PER_SCAN, MAX_VICTIM_MAX_PER_SCAN, L"VictimMaxPerScan");
+    CLAMP_MAX(leakDetection, MAX_LEAK_DETECTION, L"LeakDetection");
+    CLAMP(leakHorizonSec, MIN_LEAK_HORIZON_SEC, MAX_LEAK_HORIZON_SEC, L"LeakHorizonSec");
+    CLAMP(leakMinSamples, MIN_LEAK_MIN_SAMPLES, MAX_LEAK_MIN_SAMPLES, L"LeakMinSamples");
+    CLAMP(leakMinGrowthMbPerMin, MIN_LEAK_MIN_GROWTH_MB_PER_MIN, MAX_LEAK_MIN_GROWTH_MB_PER_MIN, L"LeakMinGrowthMbPerMin");
+    CLAMP_MAX(treeCpuThresholdPercent, MAX_TREE_CPU_THRESHOLD, L"TreeCpuThresholdPercent");
+    CLAMP_MAX(treeMemThresholdMb, MAX_TREE_MEM_THRESHOLD_MB, L"TreeMemThresholdMb");
+    CLAMP_MAX(scanWorkers, MAX_SCAN_WORKERS, L"ScanWorkers");
+    CLAMP_MAX(startStaggerMs, MAX_START_STAGGER_MS, L"StartStaggerMs");
+    CLAMP(adaptiveMinIntervalMs, MIN_ADAPTIVE_INTERVAL_MS, MAX_ADAPTIVE_INTERVAL_MS, L"AdaptiveMinIntervalMs");
+    CLAMP(adaptiveMaxIntervalMs, MIN_ADAPTIVE_INTERVAL_MS, MAX_ADAPTIVE_INTERVAL_MS, L"AdaptiveMaxIntervalMs");
+    CLAMP(adaptiveNearPercent, MIN_ADAPTIVE_NEAR_PERCENT, MAX_ADAPTIVE_NEAR_PERCENT, L"AdaptiveNearPercent");
+    CLAMP_MAX(tierHotPercent, MAX_TIER_PERCENT, L"TierHotPercent");
+    CLAMP_MAX(tierWarmPercent, MAX_TIER_PERCENT, L"TierWarmPercent");
+    CLAMP(tierWarmEvery, MIN_TIER_WARM_EVERY, MAX_TIER_WARM_EVERY, L"TierWarmEvery");
+    CLAMP(tierColdBatch, MIN_TIER_COLD_BATCH, MAX_TIER_COLD_BATCH, L"TierColdBatch");
+    CLAMP_MAX(scanBudgetProcesses, MAX_SCAN_BUDGET_PROCESSES, L"ScanBudgetProcesses");
+    CLAMP_MAX(scanBudgetUs, MAX_SCAN_BUDGET_US, L"ScanBudgetUs");
+    CLAMP_MAX(selfCpuBudgetPercent, MAX_SELF_CPU_BUDGET_PERCENT, L"SelfCpuBudgetPercent");
+    CLAMP_MAX(selfMemoryBudgetMb, MAX_SELF_MEMORY_BUDGET_MB, L"SelfMemoryBudgetMb");
+    CLAMP_MAX(watchdogStallMs, MAX_WATCHDOG_STALL_MS, L"WatchdogStallMs");
 #undef CLAMP
+#undef CLAMP_MAX
 
     if (clamped && (now - g.lastClampWarningTick >= WARNING_COOLDOWN_MS))
     {
@@ -2155,25 +6142,27 @@ BOOL LoadConfig(void)
     int newExcludeCount = 0;
     WCHAR newExcludeList[MAX_EXCLUDE_COUNT][MAX_PATH_LEN] = {0};
     BOOL excludeWarning = FALSE;
-
-    DWORD excludeSize = GetPrivateProfileStringW(L"Settings", L"ExcludeProcesses", L"", NULL, 0, configPath);
-    if (excludeSize > 0)
+    BOOL keepExcludeList = FALSE;
+
+    // Large enough for MAX_EXCLUDE_COUNT full-length entries and their separators;
+    // anything past that would be dropped by SplitExcludeString anyway. On the heap
+    // because LoadConfig also runs on the monitor thread.
+    const DWORD excludeBufferLen = MAX_EXCLUDE_COUNT * (MAX_PATH_LEN + 1);
+    WCHAR *excludeBuffer = (WCHAR *)malloc(excludeBufferLen * sizeof(WCHAR));
+    if (excludeBuffer)
     {
-        WCHAR *excludeBuffer = (WCHAR *)malloc(excludeSize * sizeof(WCHAR));
-        if (excludeBuffer)
-        {
-            DWORD copied = GetPrivateProfileStringW(L"Settings", L"ExcludeProcesses", L"",
-                                                    excludeBuffer, excludeSize, configPath);
-            if (copied > 0)
-            {
-                SplitExcludeString(excludeBuffer, newExcludeList, &newExcludeCount, &excludeWarning);
-            }
-            free(excludeBuffer);
-        }
-        else
+        DWORD copied = GetPrivateProfileStringW(L"Settings", L"ExcludeProcesses", L"",
+                                                excludeBuffer, excludeBufferLen, configPath);
+        if (copied > 0)
         {
-            LogError(L"Failed to allocate memory for exclude list; exclude list will be empty.");
+            SplitExcludeString(excludeBuffer, newExcludeList, &newExcludeCount, &excludeWarning);
         }
+        free(excludeBuffer);
+    }
+    else
+    {
+        LogMessage(L"Out of memory reading ExcludeProcesses; keeping the previous exclude list.");
+        keepExcludeList = TRUE;
     }
 
     if (excludeWarning && (now - g.lastExcludeWarningTick >= WARNING_COOLDOWN_MS))
@@ -2211,10 +6200,18 @@ BOOL LoadConfig(void)
         CloseHandle(hFile);
     }
 
-    EnterCriticalSection(&g.csConfig);
+    EnterSharedLock(&g.csConfig);
+    if (keepExcludeList)
+    {
+        newConfig.excludeCount = g.config.excludeCount;
+        memcpy(newConfig.excludeList, g.config.excludeList, sizeof(newConfig.excludeList));
+    }
+    else
+    {
+        newConfig.excludeCount = newExcludeCount;
+        memcpy(newConfig.excludeList, newExcludeList, sizeof(newExcludeList));
+    }
     g.config = newConfig;
-    g.config.excludeCount = newExcludeCount;
-    memcpy(g.config.excludeList, newExcludeList, sizeof(newExcludeList));
     LeaveCriticalSection(&g.csConfig);
 
     return TRUE;
@@ -2239,6 +6236,63 @@ void CreateDefaultConfig(void)
         fprintf(f, "MaxHungWindows=500\n");
         fprintf(f, "NotifyOnTermination=0\n");
         fprintf(f, "StartMonitoringOnLaunch=1\n");
+        fprintf(f, "CpuAction=terminate\n");
+        fprintf(f, "MemAction=terminate\n");
+        fprintf(f, "ThrottleAffinityCores=1\n");
+        fprintf(f, "CpuRateCapPercent=25\n");
+        fprintf(f, "ThrottleIdlePriority=0\n");
+        fprintf(f, "MemCapCommitLimitMb=0\n");
+        fprintf(f, "MemCapEscalateMs=60000\n");
+        fprintf(f, "TreeAggregation=0\n");
+        fprintf(f, "TreeCpuThresholdPercent=90\n");
+        fprintf(f, "TreeMemThresholdMb=2048\n");
+        fprintf(f, "MemMetric=workingset\n");
+        fprintf(f, "LeakDetection=0\n");
+        fprintf(f, "LeakHorizonSec=600\n");
+        fprintf(f, "LeakMinSamples=12\n");
+        fprintf(f, "LeakMinGrowthMbPerMin=5\n");
+        fprintf(f, "CpuNormalization=core\n");
+        fprintf(f, "CpuSaturationPercent=0\n");
+        fprintf(f, "PressureGating=0\n");
+        fprintf(f, "PressureCpuPercent=70\n");
+        fprintf(f, "PressureMemoryPercent=85\n");
+        fprintf(f, "PressureCommitPercent=90\n");
+        fprintf(f, "VictimSelection=0\n");
+        fprintf(f, "VictimMaxPerScan=1\n");
+        fprintf(f, "CpuGraceSec=0\n");
+        fprintf(f, "MemGraceSec=0\n");
+        fprintf(f, "HangGraceSec=0\n");
+        fprintf(f, "AgeRampSec=0\n");
+        fprintf(f, "AgeThresholdScalePercent=200\n");
+        fprintf(f, "HysteresisExitPercent=90\n");
+        fprintf(f, "ViolationDwellMs=0\n");
+        fprintf(f, "RecoveryDwellMs=30000\n");
+        fprintf(f, "KillRatePerMinute=0\n");
+        fprintf(f, "CpuKillRatePerMinute=0\n");
+        fprintf(f, "MemKillRatePerMinute=0\n");
+        fprintf(f, "HangKillRatePerMinute=0\n");
+        fprintf(f, "StormThreshold=0\n");
+        fprintf(f, "CpuCloseTimeoutMs=0\n");
+        fprintf(f, "MemCloseTimeoutMs=0\n");
+        fprintf(f, "HangCloseTimeoutMs=0\n");
+        fprintf(f, "ScanWorkers=0\n");
+        fprintf(f, "OverrunPolicy=skip\n");
+        fprintf(f, "StartStaggerMs=0\n");
+        fprintf(f, "AdaptiveInterval=0\n");
+        fprintf(f, "AdaptiveMinIntervalMs=1000\n");
+        fprintf(f, "AdaptiveMaxIntervalMs=30000\n");
+        fprintf(f, "AdaptiveNearPercent=80\n");
+        fprintf(f, "TieredSampling=0\n");
+        fprintf(f, "TierHotPercent=50\n");
+        fprintf(f, "TierWarmPercent=10\n");
+        fprintf(f, "TierWarmEvery=4\n");
+        fprintf(f, "TierColdBatch=64\n");
+        fprintf(f, "ScanBudgetProcesses=0\n");
+        fprintf(f, "ScanBudgetUs=0\n");
+        fprintf(f, "BackgroundMode=0\n");
+        fprintf(f, "SelfCpuBudgetPercent=0\n");
+        fprintf(f, "SelfMemoryBudgetMb=0\n");
+        fprintf(f, "WatchdogStallMs=0\n");
         fprintf(f, "ExcludeProcesses=\n\n");
         fprintf(f, "; Process Monitor Configuration File\n");
         fprintf(f, "; All times are in milliseconds.\n");
@@ -2248,6 +6302,40 @@ void CreateDefaultConfig(void)
         fprintf(f, "; ExcludeProcesses: comma or semicolon separated list (e.g., notepad.exe,calc.exe)\n");
         fprintf(f, "; Note: CPU threshold is total process CPU time (may exceed 100%% on multi-core).\n");
         fprintf(f, "; MaxHungWindows: limit number of windows to check for hanging (10-5000).\n");
+        fprintf(f, "; CpuAction / MemAction: terminate, priority, affinity, cpucap (Windows 8+) or memcap.\n");
+        fprintf(f, "; memcap: working set is held at MemThresholdMb and commit limited to MemCapCommitLimitMb (0 = 2x threshold);\n");
+        fprintf(f, ";   the process is terminated if reclaim pressure lasts longer than MemCapEscalateMs.\n");
+        fprintf(f, "; ThrottleAffinityCores: cores kept by 'affinity'. CpuRateCapPercent: limit for 'cpucap' (percent of one core).\n");
+        fprintf(f, "; TreeAggregation: 1 to also apply CPU/memory rules to whole process trees (action taken on the tree root).\n");
+        fprintf(f, ";   Below a shell or terminal (cmd, PowerShell, Windows Terminal, explorer) only the heaviest subtree is judged.\n");
+        fprintf(f, ";   TreeCpuThresholdPercent / TreeMemThresholdMb: tree limits (0 = no tree rule for that resource).\n");
+        fprintf(f, "; MemMetric: workingset, private (private bytes / commit) or privatews (private working set, measured only above the threshold).\n");
+        fprintf(f, "; LeakDetection: 0 = off, 1 = log processes whose memory trend will reach MemThresholdMb within LeakHorizonSec, 2 = also apply MemAction.\n");
+        fprintf(f, "; LeakMinSamples (4-32) samples are needed before the trend is trusted; growth below LeakMinGrowthMbPerMin is ignored.\n");
+        fprintf(f, "; CpuNormalization: unit of CpuThresholdPercent - core (percent of one core), machine (percent of all cores) or allowed (percent of the cores in the process's affinity).\n");
+        fprintf(f, "; CpuSaturationPercent: flag processes keeping every core they may use at least this busy (0 = off).\n");
+        fprintf(f, "; PressureGating: 1 = enforce CPU/memory rules only while the system is under pressure (total CPU, memory load or commit charge at or above the Pressure* percentages).\n");
+        fprintf(f, "; VictimSelection: 1 = act on memory-rule breaches only while memory is short (PressureMemoryPercent / PressureCommitPercent), worst VictimMaxPerScan processes first.\n");
+        fprintf(f, "; CpuGraceSec / MemGraceSec / HangGraceSec: rules are not enforced until a process is this many seconds old (it is still sampled; 0 = off).\n");
+        fprintf(f, "; AgeRampSec: after the grace period, CPU and memory thresholds start at AgeThresholdScalePercent and fall to normal over this many seconds (0 = off).\n");
+        fprintf(f, "; HysteresisExitPercent: a violating process counts as recovered only below this percentage of the thresholds, for RecoveryDwellMs in a row.\n");
+        fprintf(f, "; ViolationDwellMs: how long a threshold must stay exceeded before the rule is enforced (0 = immediately).\n");
+        fprintf(f, "; KillRatePerMinute / CpuKillRatePerMinute / MemKillRatePerMinute / HangKillRatePerMinute: termination rate limits (0 = unlimited).\n");
+        fprintf(f, "; StormThreshold: if more processes than this violate rules in one scan, terminations are suspended (log only) until it calms down (0 = off).\n");
+        fprintf(f, "; CpuCloseTimeoutMs / MemCloseTimeoutMs / HangCloseTimeoutMs: ask the process's windows to close (WM_CLOSE) and force termination only if it has not exited after this long (0 = terminate at once).\n");
+        fprintf(f, "; ScanWorkers: threads that measure processes in parallel (0 = one per logical processor, up to 4; 1 = measure on the monitor thread only).\n");
+        fprintf(f, "; OverrunPolicy: what to do with ticks missed while a scan ran longer than MonitorIntervalMs - skip (wait for the next tick) or coalesce (run one tick at once).\n");
+        fprintf(f, "; StartStaggerMs: delay the first scan by a per-machine offset below this value, derived from the computer name (0 = off).\n");
+        fprintf(f, "; AdaptiveInterval: 1 = scan faster while a process is close to a threshold or the system is under pressure, and slower while idle.\n");
+        fprintf(f, "; AdaptiveMinIntervalMs / AdaptiveMaxIntervalMs: bounds of the adaptive interval (the range always includes MonitorIntervalMs).\n");
+        fprintf(f, "; AdaptiveNearPercent: a process above this percentage of CpuThresholdPercent or MemThresholdMb counts as close to a threshold.\n");
+        fprintf(f, "; TieredSampling: 1 = measure processes far from every threshold less often (hot every scan, warm every TierWarmEvery scans, cold in round-robin batches).\n");
+        fprintf(f, "; TierHotPercent / TierWarmPercent: percentage of CpuThresholdPercent or MemThresholdMb from which a process is hot / warm.\n");
+        fprintf(f, "; TierWarmEvery: scans between two samples of a warm process. TierColdBatch: cold processes sampled per scan.\n");
+        fprintf(f, "; ScanBudgetProcesses / ScanBudgetUs: at most this many warm and cold processes / microseconds of measurement per scan with TieredSampling (0 = unlimited; hot processes are always measured on top).\n");
+        fprintf(f, "; BackgroundMode: 1 = run the measurement worker threads in background mode (lower CPU, I/O and memory priority).\n");
+        fprintf(f, "; SelfCpuBudgetPercent / SelfMemoryBudgetMb: CPU (percent of one core) and working set the monitor itself may use; above them it scans less often and skips status details (0 = no budget).\n");
+        fprintf(f, "; WatchdogStallMs: a phase of the monitor thread running longer than this is logged with its PID and, where possible, abandoned (0 = watchdog off).\n");
         fprintf(f, "; IMPORTANT: Save this file in ANSI encoding (system default code page).\n");
         fprintf(f, "; If you use UTF-8 without BOM, non-ASCII characters may not be read correctly.\n");
         fclose(f);
@@ -2276,10 +6364,40 @@ static void ShowBalloon(const WCHAR *title, const WCHAR *text, DWORD infoFlags)
 // -------------------- Show Status Dialog (simple MessageBox) --------------------
 static void ShowStatusDialog(HWND hwnd)
 {
-    WCHAR status[256];
-    swprintf(status, 256, L"Process Monitor v%s\n\nMonitoring is %s.",
-             VERSION_STRING,
-             InterlockedCompareExchange(&g.monitorActive, 0, 0) ? L"ON" : L"OFF");
+    WCHAR status[2048];
+    int len = swprintf(status, 2048, L"Process Monitor v%s\n\nMonitoring is %s.",
+                       VERSION_STRING,
+                       InterlockedCompareExchange(&g.monitorActive, 0, 0) ? L"ON" : L"OFF");
+    SCAN_STATUS st;
+    if (len > 0 && ReadScanStatus(&st) && st.scanTick != 0)
+    {
+        len += swprintf(status + len, 2048 - len,
+                        L"\n\nLast scan: %llu s ago, %lu ms, %lu processes, %lu tracked"
+                        L"\nHistory lookups: %lu (lock-free), shared lock waits: %ld"
+                        L"\nHeap allocations: %ld, near a limit: %lu"
+                        L"\nTicks: %llu, overruns: %lu, skipped: %lu, lateness avg %lu ms, max %lu ms"
+                        L"\nInterval: %lu ms (shortened %lu, lengthened %lu), monitor CPU: %lu ms per hour"
+                        L"\nMonitor: %lu ms CPU last tick (max %lu), %lu MB, governor level %lu (%lu ticks)",
+                        (unsigned long long)((GetTickCount64() - st.scanTick) / 1000), st.scanMs,
+                        st.processCount, st.trackedCount, st.historyLookups, st.lockWaits, st.heapAllocs,
+                        st.nearLimitCount, st.ticks, st.overruns, st.skippedTicks, st.lateAvgMs, st.lateMaxMs,
+                        st.intervalMs, st.shortened, st.lengthened, st.cpuMsPerHour, st.tickCpuMs, st.tickCpuMaxMs,
+                        st.selfMemMB, st.governorLevel, st.governedTicks);
+        if (len > 0)
+            len += swprintf(status + len, 2048 - len, L"\nStalls: %ld (abandoned %ld), slowest phase: %ls %lu ms",
+                            st.stalls, st.abandoned, PHASE_NAMES[st.slowestPhase], st.slowestPhaseMs);
+        if (len > 0 && st.tiered)
+            len += swprintf(status + len, 2048 - len, L"\nSampled: %lu hot, %lu warm, %lu cold, %lu deferred",
+                            st.sampled[TIER_HOT], st.sampled[TIER_WARM], st.sampled[TIER_COLD], st.deferred);
+        if (len > 0 && st.detailsShed)
+            len += swprintf(status + len, 2048 - len, L"\nTracked count and highest use: from before the self-budget governor engaged");
+        if (len > 0 && st.topCpuPid)
+            len += swprintf(status + len, 2048 - len, L"\nHighest CPU: %ls (PID %lu) %.1f%%",
+                            st.topCpuName, st.topCpuPid, st.topCpu);
+        if (len > 0 && st.topMemPid)
+            swprintf(status + len, 2048 - len, L"\nHighest memory: %ls (PID %lu) %llu MB",
+                     st.topMemName, st.topMemPid, (unsigned long long)st.topMemMB);
+    }
     MessageBoxW(hwnd, status, L"Process Monitor", MB_OK | MB_ICONINFORMATION);
 }
 
@@ -2312,17 +6430,82 @@ static void DeleteTemporaryLogFile(void)
 void Cleanup(void)
 {
     InterlockedExchange(&g.programRunning, 0);
+    if (g.hWatchdogThread)
+    {
+        // Joined first: it uses the monitor thread handle.
+        SetEvent(g.hStopEvent);
+        WaitForSingleObject(g.hWatchdogThread, 5000);
+        CloseHandle(g.hWatchdogThread);
+        g.hWatchdogThread = NULL;
+    }
+    // A scan thread still running (stuck in a system call) may yet touch the scan arrays,
+    // history, pools and handles, so those are then left to process exit.
+    BOOL scanThreadsExited = TRUE;
     if (g.hMonitorThread)
     {
         SetEvent(g.hStopEvent);
-        for (int i = 0; i < 10; i++)
-        {
-            if (WaitForSingleObject(g.hMonitorThread, 500) == WAIT_OBJECT_0)
-                break;
-        }
+        scanThreadsExited = FALSE;
+        for (int i = 0; i < 10 && !scanThreadsExited; i++)
+            scanThreadsExited = WaitForSingleObject(g.hMonitorThread, 500) == WAIT_OBJECT_0;
         CloseHandle(g.hMonitorThread);
         g.hMonitorThread = NULL;
     }
+    if (g.scanWorkerCount)
+    {
+        SetEvent(g.hStopEvent);
+        if (WaitForMultipleObjects(g.scanWorkerCount, g.scanWorkers, TRUE, 5000) == WAIT_TIMEOUT)
+            scanThreadsExited = FALSE;
+        for (DWORD i = 0; i < g.scanWorkerCount; i++)
+            CloseHandle(g.scanWorkers[i]);
+        g.scanWorkerCount = 0;
+    }
+    if (!scanThreadsExited)
+        LogMessage(L"Scan threads did not stop within 5000 ms, leaving scan state to process exit");
+    if (g.hScanWorkSemaphore && scanThreadsExited)
+    {
+        CloseHandle(g.hScanWorkSemaphore);
+        g.hScanWorkSemaphore = NULL;
+    }
+    if (g.hScanDoneEvent && scanThreadsExited)
+    {
+        CloseHandle(g.hScanDoneEvent);
+        g.hScanDoneEvent = NULL;
+    }
+    BOOL actionThreadExited = TRUE;
+    if (g.hActionThread)
+    {
+        SetEvent(g.hStopEvent);
+        // Bounded by TERMINATE_CONFIRM_TIMEOUT_MS, which also wakes on the stop event.
+        if (WaitForSingleObject(g.hActionThread, 5000) != WAIT_OBJECT_0)
+        {
+            // Still inside a termination call: it owns its request and keeps using the
+            // queues, the log and the string table, so those are left to process exit.
+            actionThreadExited = FALSE;
+            LogMessage(L"Action thread did not stop within 5000 ms, leaving its state to process exit");
+        }
+        CloseHandle(g.hActionThread);
+        g.hActionThread = NULL;
+    }
+    // Cancel outstanding graceful-close waits; INVALID_HANDLE_VALUE waits for any callback
+    // already running, which sees actionShutdown and leaves the request to us.
+    EnterCriticalSection(&g.csActions);
+    g.actionShutdown = TRUE;
+    TERMINATE_REQUEST *waiting = g.actionWaiting;
+    g.actionWaiting = NULL;
+    LeaveCriticalSection(&g.csActions);
+    while (waiting)
+    {
+        TERMINATE_REQUEST *next = waiting->next;
+        UnregisterWaitEx(waiting->hWait, INVALID_HANDLE_VALUE);
+        CloseHandle(waiting->hProcess);
+        free(waiting);
+        waiting = next;
+    }
+    if (g.hActionEvent && actionThreadExited)
+    {
+        CloseHandle(g.hActionEvent);
+        g.hActionEvent = NULL;
+    }
 
     if (g.hWnd)
     {
@@ -2334,25 +6517,58 @@ void Cleanup(void)
 
     DeleteTemporaryLogFile();
 
-    CleanupBalloonCooldown();
-
     // No custom icon to destroy
 
-    EnterCriticalSection(&g.csHistory);
-    PROCESS_HISTORY *curr = g.history;
-    while (curr)
+    if (scanThreadsExited)
     {
-        PROCESS_HISTORY *tmp = curr;
-        curr = curr->next;
-        free(tmp);
+        CleanupBalloonCooldown();
+        PoolDestroy(&g.balloonPool);
+
+        // A scan interrupted by shutdown can leave worker-created records unlinked.
+        for (DWORD i = 0; i < g.scanCount; i++)
+        {
+            if (g.scan[i].sample.histPending)
+            {
+                if (g.scan[i].sample.hist)
+                    FreeHistoryNode(g.scan[i].sample.hist);
+                g.scan[i].sample.histPending = FALSE;
+            }
+        }
+        ResetAllHistory();
+        PoolDestroy(&g.historyPool);
+        ArenaDestroy(&g.scanArena);
+
+        for (DWORD i = 0; i <= MAX_SCAN_WORKERS; i++)
+        {
+            free(g.scanWorkerState[i].wsInfo);
+            g.scanWorkerState[i].wsInfo = NULL;
+        }
+        free(g.scan);
+        free(g.scanQueue);
+        free(g.scanPidTable);
+        free(g.counters.block);
+        memset(&g.counters, 0, sizeof(g.counters));
+        g.scan = NULL;
+        g.scanQueue = NULL;
+        g.scanPidTable = NULL;
+        g.scanCount = g.scanCapacity = g.scanPidTableSize = 0;
+
+        DeleteCriticalSection(&g.csConfig);
+        DeleteCriticalSection(&g.csBalloon);
     }
-    g.history = NULL;
-    LeaveCriticalSection(&g.csHistory);
 
-    DeleteCriticalSection(&g.csHistory);
-    DeleteCriticalSection(&g.csLog);
-    DeleteCriticalSection(&g.csConfig);
-    DeleteCriticalSection(&g.csBalloon);
+    if (scanThreadsExited && actionThreadExited)
+    {
+        DeleteCriticalSection(&g.csLog);
+        FreeTerminateRequests(g.actionQueue);
+        FreeTerminateRequests(g.actionResults);
+        g.actionQueue = g.actionResults = NULL;
+        DeleteCriticalSection(&g.csActions);
+
+        // Nothing refers to interned strings any more.
+        FreeStringTable();
+        DeleteCriticalSection(&g.csStrings);
+    }
 
     if (g.hMutex)
         CloseHandle(g.hMutex);